@@ -8,4 +8,4 @@ mkdir -p sysroot/boot/grub
 cp grub.cfg sysroot/boot/grub/grub.cfg
 cp ramdisk sysroot/boot/ramdisk
 grub-mkrescue sysroot -o asternix.iso
-qemu-system-i386 -cdrom asternix.iso -s
\ No newline at end of file
+qemu-system-i386 -cdrom asternix.iso -smp "${SMP:-4}" -s
\ No newline at end of file
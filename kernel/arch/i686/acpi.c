@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <x86/acpi.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <x86/mem.h>
+
+#define MAX_TABLES 32
+
+static const struct acpi_sdt_header *tables[MAX_TABLES];
+static size_t num_tables;
+
+static bool checksum_ok(const void *p, size_t len)
+{
+    const uint8_t *bytes = p;
+    uint8_t sum = 0;
+
+    for (size_t i = 0; i < len; i++)
+        sum += bytes[i];
+    return sum == 0;
+}
+
+/* Maps the table at `phys`, which may lie anywhere in physical memory. */
+static const struct acpi_sdt_header *map_table(uint32_t phys)
+{
+    const struct acpi_sdt_header *hdr = mem_map_range(K_MEM_DEV_START,
+        phys, phys + sizeof(*hdr), PG_PRES);
+    if (!hdr)
+        return NULL;
+
+    /* Map again if the table doesn't end within the pages mapped already. */
+    uint32_t mapped_end = (phys + sizeof(*hdr) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (phys + hdr->length > mapped_end)
+        hdr = mem_map_range(K_MEM_DEV_START, phys, phys + hdr->length, PG_PRES);
+    if (!hdr)
+        return NULL;
+
+    if (!checksum_ok(hdr, hdr->length)) {
+        char sig[5] = { 0 };
+        memcpy(sig, hdr->signature, 4);
+        printf("warn: acpi: bad checksum on table %s at %08x\n", sig, phys);
+        return NULL;
+    }
+    return hdr;
+}
+
+void acpi_init(struct multiboot_tag *tag)
+{
+    if (!tag) {
+        printf("warn: acpi: no RSDP from bootloader\n");
+        return;
+    }
+
+    const struct acpi_rsdp *rsdp =
+        (void *)((struct multiboot_tag_new_acpi *)tag)->rsdp;
+    if (memcmp(rsdp->signature, "RSD PTR ", 8) != 0 ||
+            !checksum_ok(rsdp, offsetof(struct acpi_rsdp, length))) {
+        printf("warn: acpi: invalid RSDP\n");
+        return;
+    }
+
+    /* Prefer the XSDT (64-bit pointers) if it is reachable at all. */
+    bool xsdt = rsdp->revision >= 2 && rsdp->xsdt_addr &&
+        rsdp->xsdt_addr <= UINT32_MAX;
+    const struct acpi_sdt_header *root = map_table(
+        xsdt ? (uint32_t)rsdp->xsdt_addr : rsdp->rsdt_addr);
+    if (!root)
+        return;
+
+    size_t entry_size = xsdt ? 8 : 4;
+    size_t n = (root->length - sizeof(*root)) / entry_size;
+    const uint8_t *entries = (const uint8_t *)&root[1];
+
+    char oem[7] = { 0 };
+    memcpy(oem, rsdp->oem_id, 6);
+    printf("info: acpi: %s (%s), tables:", xsdt ? "XSDT" : "RSDT", oem);
+
+    for (size_t i = 0; i < n && num_tables < MAX_TABLES; i++) {
+        uint64_t phys;
+        if (xsdt)
+            memcpy(&phys, &entries[i * 8], 8);
+        else
+            phys = *(const uint32_t *)&entries[i * 4];
+
+        if (phys > UINT32_MAX)
+            continue;
+
+        const struct acpi_sdt_header *table = map_table(phys);
+        if (!table)
+            continue;
+
+        tables[num_tables++] = table;
+
+        char sig[5] = { 0 };
+        memcpy(sig, table->signature, 4);
+        printf(" %s", sig);
+    }
+    printf("\n");
+}
+
+const struct acpi_sdt_header *acpi_find_table(const char *sig)
+{
+    for (size_t i = 0; i < num_tables; i++) {
+        if (memcmp(tables[i]->signature, sig, 4) == 0)
+            return tables[i];
+    }
+    return NULL;
+}
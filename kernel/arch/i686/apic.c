@@ -0,0 +1,471 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/apic.c
+ *
+ * Local APIC and I/O APIC driver. Compared to the 8259s, masking a line is a
+ * single MMIO write to its redirection entry and EOI is an MMIO write to the
+ * local APIC, no port I/O involved.
+ * see also: kernel/arch/i686/include/x86/apic.h
+ */
+
+#include <x86/apic.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <irq.h>
+#include <irqflags.h>
+#include <timer.h>
+#include <x86/acpi.h>
+#include <x86/cpu.h>
+#include <x86/interrupts.h>
+#include <x86/mem.h>
+#include <x86/pio.h>
+#include <x86/pit.h>
+
+/* Local APIC registers (offsets into the MMIO page) */
+
+#define LAPIC_ID 0x020
+#define LAPIC_VERSION 0x030
+#define LAPIC_TPR 0x080
+#define LAPIC_EOI 0x0b0
+#define LAPIC_SVR 0x0f0
+#define LAPIC_ESR 0x280
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_LINT0 0x350
+#define LAPIC_LVT_LINT1 0x360
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3e0
+
+#define SVR_ENABLE (1 << 8)
+
+#define LVT_DELIVERY_NMI (4 << 8)
+#define LVT_MASKED (1 << 16)
+#define LVT_TIMER_PERIODIC (1 << 17)
+
+#define TIMER_DIVIDE_16 0x3
+
+/* Interrupt command register */
+#define ICR_INIT (5 << 8)
+#define ICR_STARTUP (6 << 8)
+#define ICR_PENDING (1 << 12)
+#define ICR_ASSERT (1 << 14)
+#define ICR_LEVEL (1 << 15)
+
+/* How long to count LAPIC timer ticks for calibration. */
+#define CALIBRATE_US 10000
+
+/* I/O APIC registers (selected through IOREGSEL, accessed through IOWIN) */
+
+#define IOAPIC_IOREGSEL 0x00
+#define IOAPIC_IOWIN 0x10
+
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDTBL(pin) (0x10 + 2 * (pin))
+
+#define REDTBL_ACTIVE_LOW (1 << 13)
+#define REDTBL_LEVEL (1 << 15)
+#define REDTBL_MASKED (1 << 16)
+
+#define MAX_IOAPICS 4
+
+#define ISA_IRQS 16
+
+struct ioapic {
+    volatile uint32_t *regs;
+    uint32_t gsi_base;
+    unsigned pins;
+};
+
+/* Where an IRQ line is connected. */
+struct irq_route {
+    struct ioapic *ioapic;
+    uint8_t pin;
+    uint32_t flags; /* REDTBL_ACTIVE_LOW, REDTBL_LEVEL */
+};
+
+static volatile uint32_t *lapic;
+
+static struct ioapic ioapics[MAX_IOAPICS];
+static unsigned num_ioapics;
+
+static struct irq_route routes[NR_IOAPIC_IRQS];
+
+static uint8_t cpu_ids[MAX_CPUS];
+static unsigned num_cpus;
+
+static uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+static void lapic_write(uint32_t reg, uint32_t val)
+{
+    lapic[reg / 4] = val;
+}
+
+static uint32_t ioapic_read(struct ioapic *io, uint8_t reg)
+{
+    io->regs[IOAPIC_IOREGSEL / 4] = reg;
+    return io->regs[IOAPIC_IOWIN / 4];
+}
+
+static void ioapic_write(struct ioapic *io, uint8_t reg, uint32_t val)
+{
+    io->regs[IOAPIC_IOREGSEL / 4] = reg;
+    io->regs[IOAPIC_IOWIN / 4] = val;
+}
+
+uint8_t lapic_id()
+{
+    return lapic ? lapic_read(LAPIC_ID) >> 24 : 0;
+}
+
+unsigned apic_num_cpus()
+{
+    return num_cpus ? num_cpus : 1;
+}
+
+uint8_t apic_cpu_id(unsigned cpu)
+{
+    return cpu < num_cpus ? cpu_ids[cpu] : 0;
+}
+
+static struct ioapic *ioapic_for_gsi(uint32_t gsi)
+{
+    for (unsigned i = 0; i < num_ioapics; i++) {
+        struct ioapic *io = &ioapics[i];
+        if (gsi >= io->gsi_base && gsi < io->gsi_base + io->pins)
+            return io;
+    }
+    return NULL;
+}
+
+static void route(unsigned irq, uint32_t gsi, uint32_t flags)
+{
+    struct ioapic *io = ioapic_for_gsi(gsi);
+    if (irq >= NR_IOAPIC_IRQS || !io)
+        return;
+
+    routes[irq] = (struct irq_route){
+        .ioapic = io,
+        .pin = gsi - io->gsi_base,
+        .flags = flags,
+    };
+}
+
+static uint32_t override_flags(uint16_t mps_flags)
+{
+    uint32_t flags = 0;
+    if ((mps_flags & MADT_POLARITY_MASK) == MADT_POLARITY_LOW)
+        flags |= REDTBL_ACTIVE_LOW;
+    if ((mps_flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL)
+        flags |= REDTBL_LEVEL;
+    return flags;
+}
+
+static bool parse_madt(const struct acpi_madt *madt)
+{
+    uint32_t lapic_phys = madt->lapic_addr;
+
+    const uint8_t *p = madt->entries;
+    const uint8_t *end = (const uint8_t *)madt + madt->header.length;
+
+    /* First pass: local APICs and I/O APICs. */
+    for (; p < end; p += ((struct madt_entry *)p)->length) {
+        const struct madt_entry *e = (const void *)p;
+        if (e->length < sizeof(*e))
+            break;
+
+        switch (e->type) {
+        case MADT_LAPIC: {
+            const struct madt_lapic *l = (const void *)e;
+            if ((l->flags & MADT_LAPIC_ENABLED) && num_cpus < MAX_CPUS)
+                cpu_ids[num_cpus++] = l->apic_id;
+            break;
+        }
+
+        case MADT_IOAPIC: {
+            const struct madt_ioapic *io = (const void *)e;
+            if (num_ioapics == MAX_IOAPICS)
+                break;
+
+            struct ioapic *ioapic = &ioapics[num_ioapics];
+            ioapic->regs = mem_map_range(K_MEM_DEV_START, io->addr,
+                io->addr + PAGE_SIZE, DEFAULT_PAGE_FLAGS | PG_NCACHE);
+            if (!ioapic->regs)
+                break;
+            ioapic->gsi_base = io->gsi_base;
+            ioapic->pins = ((ioapic_read(ioapic, IOAPIC_VERSION) >> 16) & 0xff)
+                + 1;
+            num_ioapics++;
+
+            printf("info: apic: I/O APIC %d at %08x, GSIs %u-%u\n", io->id,
+                io->addr, io->gsi_base, io->gsi_base + ioapic->pins - 1);
+            break;
+        }
+
+        case MADT_LAPIC_ADDR: {
+            const struct madt_lapic_addr *a = (const void *)e;
+            if (a->addr <= UINT32_MAX)
+                lapic_phys = a->addr;
+            break;
+        }
+        }
+    }
+
+    if (!num_ioapics)
+        return false;
+
+    /* ISA IRQs are identity mapped to GSIs, edge triggered and active high,
+     * unless overridden. Everything else is PCI: level triggered, active
+     * low. */
+    for (unsigned irq = 0; irq < NR_IOAPIC_IRQS; irq++)
+        route(irq, irq, irq < ISA_IRQS ? 0 : REDTBL_ACTIVE_LOW | REDTBL_LEVEL);
+
+    for (p = madt->entries; p < end; p += ((struct madt_entry *)p)->length) {
+        const struct madt_entry *e = (const void *)p;
+        if (e->length < sizeof(*e))
+            break;
+        if (e->type != MADT_INT_OVERRIDE)
+            continue;
+
+        const struct madt_int_override *o = (const void *)e;
+        if (o->source >= ISA_IRQS)
+            continue;
+
+        /* Whatever IRQ identity mapped to that GSI doesn't exist then (e.g.
+         * IRQ 2, the cascade, when the PIT is moved to GSI 2). */
+        if (o->gsi < ISA_IRQS && o->gsi != o->source)
+            routes[o->gsi].ioapic = NULL;
+
+        route(o->source, o->gsi, override_flags(o->flags));
+    }
+
+    lapic = mem_map_range(K_MEM_DEV_START, lapic_phys, lapic_phys + PAGE_SIZE,
+        DEFAULT_PAGE_FLAGS | PG_NCACHE);
+    return lapic != NULL;
+}
+
+static void lapic_setup()
+{
+    /* Make sure the APIC is globally enabled (firmware may not have). */
+    wrmsr(MSR_APIC_BASE, rdmsr(MSR_APIC_BASE) | APIC_BASE_ENABLE);
+
+    /* Accept all priorities. */
+    lapic_write(LAPIC_TPR, 0);
+
+    /* External interrupts come through the I/O APIC now, not LINT0. LINT1 is
+     * wired to NMI on PCs. */
+    lapic_write(LAPIC_LVT_LINT0, LVT_MASKED);
+    lapic_write(LAPIC_LVT_LINT1, LVT_DELIVERY_NMI);
+    lapic_write(LAPIC_LVT_ERROR, LVT_MASKED);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+
+    /* Clear errors (needs two writes). */
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+
+    lapic_write(LAPIC_SVR, SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+
+    /* Stale in-service interrupts from before. */
+    lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_ap_init()
+{
+    lapic_setup();
+}
+
+static void send_ipi(uint8_t apic_id, uint32_t icr)
+{
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, icr);
+
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING)
+        ;
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector)
+{
+    /* An interrupt handler sending one in between would change the
+     * destination. */
+    irqflags_t flags = local_irq_save();
+    send_ipi(apic_id, vector);
+    local_irq_restore(flags);
+}
+
+void lapic_eoi()
+{
+    lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_send_init(uint8_t apic_id)
+{
+    send_ipi(apic_id, ICR_INIT | ICR_ASSERT | ICR_LEVEL);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint32_t phys)
+{
+    /* The vector is the page the CPU starts executing at (in real mode). */
+    send_ipi(apic_id, ICR_STARTUP | (phys >> 12));
+}
+
+static void ioapic_setup()
+{
+    uint32_t dest = (uint32_t)lapic_id() << 24;
+
+    /* Mask everything, lines are unmasked by `request_irq()`. */
+    for (unsigned i = 0; i < num_ioapics; i++) {
+        for (unsigned pin = 0; pin < ioapics[i].pins; pin++)
+            ioapic_write(&ioapics[i], IOAPIC_REDTBL(pin), REDTBL_MASKED);
+    }
+
+    for (unsigned irq = 0; irq < NR_IOAPIC_IRQS; irq++) {
+        struct irq_route *r = &routes[irq];
+        if (!r->ioapic)
+            continue;
+
+        ioapic_write(r->ioapic, IOAPIC_REDTBL(r->pin) + 1, dest);
+        ioapic_write(r->ioapic, IOAPIC_REDTBL(r->pin),
+            REDTBL_MASKED | r->flags | (IRQ_OFFSET + irq));
+    }
+}
+
+static void apic_set_masked(unsigned irq, bool masked)
+{
+    uint32_t reg;
+
+    if (irq == IRQ_LAPIC_TIMER) {
+        reg = lapic_read(LAPIC_LVT_TIMER);
+        reg = masked ? reg | LVT_MASKED : reg & ~LVT_MASKED;
+        lapic_write(LAPIC_LVT_TIMER, reg);
+        return;
+    }
+
+    if (irq >= NR_IOAPIC_IRQS || !routes[irq].ioapic)
+        return;
+
+    struct irq_route *r = &routes[irq];
+    reg = ioapic_read(r->ioapic, IOAPIC_REDTBL(r->pin));
+    reg = masked ? reg | REDTBL_MASKED : reg & ~REDTBL_MASKED;
+    ioapic_write(r->ioapic, IOAPIC_REDTBL(r->pin), reg);
+}
+
+static void apic_mask(unsigned irq)
+{
+    apic_set_masked(irq, true);
+}
+
+static void apic_unmask(unsigned irq)
+{
+    apic_set_masked(irq, false);
+}
+
+static void apic_eoi(unsigned irq)
+{
+    (void)irq;
+    lapic_write(LAPIC_EOI, 0);
+}
+
+static const struct irq_chip apic_chip = {
+    .name = "IO-APIC",
+    .nr_irqs = IRQ_LAPIC_TIMER + 1,
+    .vector_base = IRQ_OFFSET,
+    .mask = apic_mask,
+    .unmask = apic_unmask,
+    .eoi = apic_eoi,
+};
+
+bool apic_init()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_1_EDX_APIC) || !(edx & CPUID_1_EDX_MSR))
+        return false;
+
+    const struct acpi_madt *madt = (const void *)acpi_find_table("APIC");
+    if (!madt || !parse_madt(madt))
+        return false;
+
+    /* From now on the 8259s stay quiet. */
+    pic_disable();
+
+    lapic_setup();
+    ioapic_setup();
+
+    irq_set_chip(&apic_chip);
+
+    printf("info: apic: local APIC %d, %u CPU(s)\n", lapic_id(), num_cpus);
+    return true;
+}
+
+static enum irq_return lapic_timer_irq(unsigned irq, void *data)
+{
+    (void)irq, (void)data;
+
+    timer_tick();
+    return IRQ_HANDLED;
+}
+
+static uint32_t lapic_per_tick;
+
+static void lapic_tick_periodic()
+{
+    lapic_write(LAPIC_LVT_TIMER,
+        LVT_TIMER_PERIODIC | (IRQ_OFFSET + IRQ_LAPIC_TIMER));
+    lapic_write(LAPIC_TIMER_INITIAL, lapic_per_tick);
+}
+
+static void lapic_tick_oneshot(uint32_t ticks)
+{
+    lapic_write(LAPIC_LVT_TIMER, IRQ_OFFSET + IRQ_LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INITIAL, lapic_per_tick * ticks);
+}
+
+static struct tick_device lapic_tick = {
+    .name = "lapic",
+    .periodic = lapic_tick_periodic,
+    .oneshot = lapic_tick_oneshot,
+};
+
+bool lapic_timer_init()
+{
+    if (!lapic)
+        return false;
+
+    /* Count down from the maximum for a known time. */
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED);
+    lapic_write(LAPIC_TIMER_INITIAL, UINT32_MAX);
+    pit_wait_us(CALIBRATE_US);
+    uint32_t elapsed = UINT32_MAX - lapic_read(LAPIC_TIMER_CURRENT);
+    lapic_write(LAPIC_TIMER_INITIAL, 0);
+
+    uint32_t per_sec = elapsed * (1000000 / CALIBRATE_US);
+    uint32_t per_tick = per_sec / HZ;
+    if (!per_tick) {
+        printf("warn: apic: LAPIC timer not counting\n");
+        return false;
+    }
+
+    lapic_write(LAPIC_LVT_TIMER,
+        LVT_MASKED | LVT_TIMER_PERIODIC | (IRQ_OFFSET + IRQ_LAPIC_TIMER));
+    lapic_write(LAPIC_TIMER_INITIAL, per_tick);
+    request_irq(IRQ_LAPIC_TIMER, lapic_timer_irq, NULL);
+
+    lapic_per_tick = per_tick;
+    lapic_tick.max_ticks = UINT32_MAX / per_tick;
+    tick_set_device(&lapic_tick);
+
+    printf("info: apic: LAPIC timer at %u kHz, %d Hz tick\n",
+        per_sec / 1000, HZ);
+    return true;
+}
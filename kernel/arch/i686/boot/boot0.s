@@ -14,6 +14,19 @@
     .long module_align_tag
     .long module_align_tag_length
 
+    /* Ask for a linear framebuffer for the framebuffer console. Optional, so
+     * GRUB may still leave us in text mode (e.g. with `gfxpayload=text`). */
+    .set framebuffer_tag, 5
+    .set tag_optional, 1
+    .set framebuffer_tag_length, 20
+    .word framebuffer_tag
+    .word tag_optional
+    .long framebuffer_tag_length
+    .long 1024 /* width */
+    .long 768 /* height */
+    .long 32 /* depth */
+    .long 0 /* padding (tags are 8 byte aligned) */
+
     .set end_tag, 0
     .set end_tag_length, 8
     .long end_tag
@@ -73,7 +86,8 @@ _start:
 
     /* Provide kernel call stack. The stack grows downwards on x86. */
     movl $stack_top, %esp
-    movl %esp, %ebp
+    /* A null frame pointer ends stack traces. */
+    xorl %ebp, %ebp
 
     /* Call into high level kernel.
      * Calling convention is a bit weird: SYSTEM V ABI specifies the stack
@@ -182,7 +196,8 @@ initpt:
     .skip 4096
 
     .align 16
-    /* Kernel stack. */
+    /* Kernel stack (of the boot CPU). */
+    .global stack_top
 stack_bottom:
     .skip 8192 /* 8 KiB */
 stack_top:
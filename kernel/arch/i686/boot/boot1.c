@@ -8,14 +8,31 @@
 
 #include <vendor/grub/multiboot2.h>
 
+#include <initcall.h>
 #include <drivers/major.h>
+#include <drivers/procinfo.h>
 #include <drivers/tty.h>
 #include <drivers/block/ramdisk.h>
+#include <x86/acpi.h>
+#include <x86/apic.h>
+#include <x86/hpet.h>
 #include <x86/interrupts.h>
 #include <x86/mem.h>
+#include <x86/pio.h>
+#include <x86/pit.h>
+#include <x86/smp.h>
+#include <x86/tsc.h>
+#include <x86/vconsole.h>
 
+#include "bench.h"
 #include "fs.h"
+#include "ftrace.h"
+#include "irqsoff.h"
 #include "panic.h"
+#include "profile.h"
+#include "sched.h"
+#include "workqueue.h"
+#include "timer.h"
 
 struct multiboot_info {
     uint32_t total_size;
@@ -23,19 +40,33 @@ struct multiboot_info {
     struct multiboot_tag tags[0];
 };
 
+/* QEMU's `-device isa-debug-exit,iobase=0xf4,iosize=0x04` */
+#define QEMU_DEBUG_EXIT_PORT 0xf4
+
 /* defined in boot0.s */
 extern void halt_loop(void);
 
 extern struct fs_driver tmpfs_driver;
 
-typedef void (*initcall_f)(void);
+/* Creates a device node in the root of `fs`. */
+static void mknod(struct fs_instance *fs, const char *name, int type,
+        dev_t dev)
+{
+    fs->driver->create(fs->root, name, type);
 
-extern initcall_f __initcall_start, __initcall_end;
+    struct dentry *de = fs->driver->lookup(fs->root, name);
+    if (!de) {
+        printf("err: boot: can't create /%s\n", name);
+        return;
+    }
+    de->ino->dev_type = dev;
+    fs->driver->put(de);
+}
 
 void hlinit(struct multiboot_info *mbi_phys)
 {
+    smp_init_boot_cpu();
     mem_init();
-    tty_init();
 
     bool got_rd = false;
     bool got_meminfo = false;
@@ -44,14 +75,22 @@ void hlinit(struct multiboot_info *mbi_phys)
     uint32_t rd_start = 0;
     uint32_t rd_end = 0;
 
+    struct multiboot_tag_framebuffer *fb_tag = NULL;
+    struct multiboot_tag *acpi_tag = NULL;
+    const char *cmdline = "";
+
     /*
-     * Parse multiboot information structure.
+     * Parse multiboot information structure. Everything reserved has to be
+     * known before the first page allocation (mapping the console is the
+     * first), pages handed out to a CPU's page cache aren't taken back.
      *
-     * For now, only the memory map/info is useful for us.
-     * TODO: Parse ACPI tables, reclaim ACPI memory, get framebuffer info
+     * TODO: Reclaim ACPI memory
      */
     struct multiboot_tag *tag;
 
+    /* The command line is used until the end of boot. */
+    mem_set_used((uint32_t)mbi_phys, mbi_phys->total_size);
+
     for (tag = mbi_phys->tags;
         tag->type != MULTIBOOT_TAG_TYPE_END;
         tag = (void *)tag + ((tag->size + 7) & ~7)) {
@@ -84,14 +123,42 @@ void hlinit(struct multiboot_info *mbi_phys)
              * immediately after the kernel binary. */
             rd_start = ((struct multiboot_tag_module *)tag)->mod_start;
             rd_end = ((struct multiboot_tag_module *)tag)->mod_end;
+            mem_set_used(rd_start, rd_end - rd_start);
 
             /* Defer mapping. We should set up the memory maps first. */
             got_rd = true;
 
             break;
+
+        case MULTIBOOT_TAG_TYPE_FRAMEBUFFER:
+            /* Also needs the memory maps (and the heap). In EGA text mode,
+             * there is nothing to do, the VGA console is already set up. */
+            if (((struct multiboot_tag_framebuffer *)tag)->common
+                    .framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_EGA_TEXT)
+                fb_tag = (struct multiboot_tag_framebuffer *)tag;
+            break;
+
+        case MULTIBOOT_TAG_TYPE_ACPI_OLD:
+        case MULTIBOOT_TAG_TYPE_ACPI_NEW:
+            /* Tables are mapped later. Prefer the ACPI 2.0 RSDP. */
+            if (!acpi_tag || tag->type == MULTIBOOT_TAG_TYPE_ACPI_NEW)
+                acpi_tag = tag;
+            break;
+
+        case MULTIBOOT_TAG_TYPE_CMDLINE:
+            cmdline = ((struct multiboot_tag_string *)tag)->string;
+            break;
         }   
     }
 
+    /* Other CPUs start in real mode, so this has to stay below 1 MiB. */
+    mem_set_used(SMP_TRAMPOLINE_PHYS, PAGE_SIZE);
+
+    tty_init();
+
+    if (strstr(cmdline, "console=serial"))
+        serial_console_init(1);
+
     if (!got_meminfo || !got_mmap)
         panic(
             "Did not get required memory maps from GRUB.\n"
@@ -111,13 +178,52 @@ void hlinit(struct multiboot_info *mbi_phys)
         printf("info: added RAM disk as dev %d:%d\n", MAJOR(rd), MINOR(rd));
     }
 
+    if (fb_tag)
+        fbcon_init(fb_tag);
+
+    acpi_init(acpi_tag);
+
     setup_interrupts();
+    smp_init();
+
+    timer_init();
+    sched_init();
+    if (!lapic_timer_init())
+        pit_init();
+
+    hpet_init();
+    tsc_init();
 
-    for (initcall_f *pp = &__initcall_start; pp < &__initcall_end; pp++)
-        (**pp)();
+    do_initcalls();
 
     printf("Hello, world!\n");
 
+    /* Profiles or traces the benchmarks (if any), then prints the samples for
+     * tools/profile-fold.py or the trace for tools/ftrace-report.py. */
+    bool profiling = strstr(cmdline, "profile") && profile_start();
+    bool tracing = strstr(cmdline, "ftrace") && ftrace_start();
+
+    bench_run(cmdline);
+
+    if (tracing) {
+        ftrace_stop();
+        ftrace_dump();
+    }
+    if (profiling) {
+        profile_stop();
+        profile_dump();
+    }
+
+    if (strstr(cmdline, "bench=")) {
+        irqsoff_bench_report();
+        printf("bench: done\n");
+
+        /* For tools/bench.py, which boots QEMU with the isa-debug-exit
+         * device: exits with status (code << 1) | 1, i.e. 1. */
+        if (strstr(cmdline, "qemu_exit"))
+            outb(QEMU_DEBUG_EXIT_PORT, 0);
+    }
+
     struct fs_instance *fs = tmpfs_driver.mount(NULL, 0, NULL);
     
     fs->driver->create(fs->root, "tty1", IT_CHR);
@@ -125,6 +231,7 @@ void hlinit(struct multiboot_info *mbi_phys)
     struct dentry *de = fs->root->fs_on->driver->lookup(fs->root, "tty1");
     de->ino->dev_type = DEV(2, 1);
     de->ino->fs_on->driver->write(de->ino, 0, "\e[91;47mHello COM1", 19);
+    fs->driver->put(de);
 
     fs->driver->create(fs->root, "console", IT_CHR);
     
@@ -132,6 +239,16 @@ void hlinit(struct multiboot_info *mbi_phys)
     de->ino->dev_type = DEV(2, 0);
     de->ino->fs_on->driver->write(de->ino, 0, "Hello from character device", 27);
 
+    mknod(fs, "interrupts", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_INTERRUPTS));
+    mknod(fs, "idle", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_IDLE));
+    mknod(fs, "threads", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_THREADS));
+    mknod(fs, "workqueue", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_WORKQUEUE));
+    mknod(fs, "lockstat", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_LOCKSTAT));
+    mknod(fs, "ftrace", IT_CHR, DEV(CHR_FTRACE, 0));
+    mknod(fs, "profile", IT_CHR, DEV(CHR_PROFILE, 0));
+    mknod(fs, "rcu", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_RCU));
+    mknod(fs, "latency", IT_CHR, DEV(CHR_PROCINFO, PROCINFO_LATENCY));
+
     fs->driver->create(fs->root, "ram0", IT_BLK);
 
     char buf[4097];
@@ -139,12 +256,20 @@ void hlinit(struct multiboot_info *mbi_phys)
     ram0->ino->dev_type = DEV(1, 0);
     ram0->ino->fs_on->driver->read(ram0->ino, 0, buf, 4096);
     buf[4096] = 0;
+    fs->driver->put(ram0);
     printf("%s\n", buf);
 
+    /* The console entry stays in use (and referenced) from here on. */
+
     while (1) {
         char buf[10];
         int n;
+
+        /* Sleeps until there is input, the CPU idles meanwhile. */
         n = de->ino->fs_on->driver->read(de->ino, 0, buf, 10);
+        if (n <= 0)
+            continue;
+
         de->ino->fs_on->driver->write(de->ino, 0, buf, n);
     }
 
@@ -0,0 +1,306 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/drivers/fbcon.c
+ *
+ * Framebuffer console. Renders the virtual console's cells into a back buffer
+ * in RAM, then copies the changed rectangle to the framebuffer. Video memory
+ * is mapped write-combining, which makes writing whole rows fast but reading
+ * very slow, so scrolling is done in the back buffer instead.
+ * see also: kernel/arch/i686/include/x86/vconsole.h
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <drivers/tty.h>
+#include <x86/mem.h>
+#include <x86/vconsole.h>
+
+#define GLYPH_WIDTH 8
+#define GLYPH_HEIGHT 16
+
+/* The font is 8x8, every font row is drawn this many times to get the 8x16
+ * cells of VGA text mode. */
+#define GLYPH_SCALE (GLYPH_HEIGHT / 8)
+
+#define NUM_GLYPHS 128
+
+/* defined in fbfont.c */
+extern const uint8_t fbfont[NUM_GLYPHS][8];
+
+/* VGA text mode colors (0xRRGGBB), indexed by attribute nibble. */
+static const uint32_t vga_colors[16] = {
+    0x000000, 0x0000aa, 0x00aa00, 0x00aaaa,
+    0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+    0x555555, 0x5555ff, 0x55ff55, 0x55ffff,
+    0xff5555, 0xff55ff, 0xffff55, 0xffffff,
+};
+
+static uint32_t *fb;
+static size_t fb_stride;
+
+/* Back buffer, `width` pixels per line. */
+static uint32_t *back;
+static size_t width, height;
+
+static size_t cols, rows;
+static const uint16_t *cells;
+
+/* `vga_colors` converted to the framebuffer's pixel format. */
+static uint32_t palette[16];
+
+/*
+ * Glyph cache. Every glyph is pre-rendered at full cell size, with one 32-bit
+ * mask per pixel (all ones for foreground, all zeroes for background), so
+ * drawing a glyph in any color is just `(mask & fg) | (~mask & bg)` per pixel.
+ */
+static uint32_t (*glyphs)[GLYPH_HEIGHT][GLYPH_WIDTH];
+
+/* Text lines to scroll before drawing anything else. Consecutive scrolls
+ * (e.g. when writing a lot of lines at once) only move the back buffer once. */
+static size_t pending_scroll;
+
+/* Rectangle of the back buffer not yet copied to the framebuffer (pixels). */
+static size_t dirty_x0, dirty_y0, dirty_x1, dirty_y1;
+
+/* Cell the cursor is drawn on, or `SIZE_MAX` if not drawn. */
+static size_t cursor = SIZE_MAX;
+
+static void copy32(uint32_t *dest, const uint32_t *src, size_t n)
+{
+    /* Forward copy, so also fine for overlapping regions if dest < src. */
+    asm volatile ("rep movsl"
+        : "+D"(dest), "+S"(src), "+c"(n) :: "memory");
+}
+
+static void fill32(uint32_t *dest, uint32_t val, size_t n)
+{
+    asm volatile ("rep stosl"
+        : "+D"(dest), "+c"(n) : "a"(val) : "memory");
+}
+
+static void mark_dirty(size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    if (dirty_x0 >= dirty_x1 || dirty_y0 >= dirty_y1) {
+        dirty_x0 = x0;
+        dirty_y0 = y0;
+        dirty_x1 = x1;
+        dirty_y1 = y1;
+        return;
+    }
+    dirty_x0 = x0 < dirty_x0 ? x0 : dirty_x0;
+    dirty_y0 = y0 < dirty_y0 ? y0 : dirty_y0;
+    dirty_x1 = x1 > dirty_x1 ? x1 : dirty_x1;
+    dirty_y1 = y1 > dirty_y1 ? y1 : dirty_y1;
+}
+
+static void apply_scroll()
+{
+    if (!pending_scroll)
+        return;
+
+    size_t text_height = rows * GLYPH_HEIGHT;
+    size_t lines = pending_scroll * GLYPH_HEIGHT;
+    lines = lines < text_height ? lines : text_height;
+
+    copy32(back, &back[lines * width], (text_height - lines) * width);
+    fill32(&back[(text_height - lines) * width], palette[0], lines * width);
+
+    /* The cursor scrolled along with everything else. */
+    if (cursor != SIZE_MAX)
+        cursor = cursor >= pending_scroll * cols ?
+            cursor - pending_scroll * cols : SIZE_MAX;
+
+    pending_scroll = 0;
+    mark_dirty(0, 0, cols * GLYPH_WIDTH, text_height);
+}
+
+/*
+ * Draws `n` cells (not wrapping around) starting at `row`, `col`. Goes through
+ * the span one pixel row at a time, so every back buffer line is written
+ * front to back in one go.
+ */
+static void draw_span(const uint16_t *span, size_t row, size_t col, size_t n)
+{
+    uint32_t *line = &back[row * GLYPH_HEIGHT * width + col * GLYPH_WIDTH];
+
+    for (size_t y = 0; y < GLYPH_HEIGHT; y++, line += width) {
+        uint32_t *dest = line;
+        for (size_t i = 0; i < n; i++) {
+            uint16_t cell = span[i];
+            uint8_t ch = cell & 0xff;
+            uint32_t fg = palette[(cell >> 8) & 0xf];
+            uint32_t bg = palette[(cell >> 12) & 0xf];
+            const uint32_t *mask = glyphs[ch < NUM_GLYPHS ? ch : '?'][y];
+
+            for (size_t x = 0; x < GLYPH_WIDTH; x++)
+                dest[x] = (mask[x] & fg) | (~mask[x] & bg);
+            dest += GLYPH_WIDTH;
+        }
+    }
+
+    mark_dirty(col * GLYPH_WIDTH, row * GLYPH_HEIGHT,
+        (col + n) * GLYPH_WIDTH, (row + 1) * GLYPH_HEIGHT);
+}
+
+static void fbcon_draw(const uint16_t *new_cells, size_t start, size_t end)
+{
+    cells = new_cells;
+
+    apply_scroll();
+
+    while (start < end) {
+        size_t row = start / cols, col = start % cols;
+        size_t n = cols - col < end - start ? cols - col : end - start;
+        draw_span(&cells[start], row, col, n);
+        start += n;
+    }
+}
+
+static void fbcon_scroll(size_t lines)
+{
+    pending_scroll += lines;
+}
+
+static void fbcon_show(const uint16_t *new_cells)
+{
+    /* Nothing on screen belongs to the new console, start over. */
+    pending_scroll = 0;
+    cursor = SIZE_MAX;
+    fbcon_draw(new_cells, 0, cols * rows);
+}
+
+static void draw_cursor(size_t pos)
+{
+    uint32_t fg = palette[(cells[pos] >> 8) & 0xf];
+    size_t row = pos / cols, col = pos % cols;
+
+    /* Underline in the last two pixel rows of the cell. */
+    for (size_t y = GLYPH_HEIGHT - 2; y < GLYPH_HEIGHT; y++)
+        fill32(&back[(row * GLYPH_HEIGHT + y) * width + col * GLYPH_WIDTH],
+            fg, GLYPH_WIDTH);
+
+    mark_dirty(col * GLYPH_WIDTH, row * GLYPH_HEIGHT,
+        (col + 1) * GLYPH_WIDTH, (row + 1) * GLYPH_HEIGHT);
+}
+
+static void fbcon_flush(size_t pos)
+{
+    apply_scroll();
+
+    /* Erase the old cursor, then draw the new one. */
+    if (cursor != SIZE_MAX)
+        draw_span(&cells[cursor], cursor / cols, cursor % cols, 1);
+    cursor = pos < cols * rows ? pos : SIZE_MAX;
+    if (cursor != SIZE_MAX)
+        draw_cursor(cursor);
+
+    if (dirty_x0 >= dirty_x1 || dirty_y0 >= dirty_y1)
+        return;
+
+    for (size_t y = dirty_y0; y < dirty_y1; y++)
+        copy32(&fb[y * fb_stride + dirty_x0], &back[y * width + dirty_x0],
+            dirty_x1 - dirty_x0);
+
+    dirty_x0 = dirty_x1 = dirty_y0 = dirty_y1 = 0;
+}
+
+static const struct vconsole_ops fbcon_ops = {
+    .draw = fbcon_draw,
+    .scroll = fbcon_scroll,
+    .flush = fbcon_flush,
+    .show = fbcon_show,
+};
+
+static uint32_t make_color(uint32_t rgb, struct multiboot_tag_framebuffer *tag)
+{
+    uint32_t r = (rgb >> 16) & 0xff, g = (rgb >> 8) & 0xff, b = rgb & 0xff;
+
+    r >>= 8 - tag->framebuffer_red_mask_size;
+    g >>= 8 - tag->framebuffer_green_mask_size;
+    b >>= 8 - tag->framebuffer_blue_mask_size;
+
+    return r << tag->framebuffer_red_field_position |
+        g << tag->framebuffer_green_field_position |
+        b << tag->framebuffer_blue_field_position;
+}
+
+static void render_glyphs()
+{
+    for (size_t ch = 0; ch < NUM_GLYPHS; ch++) {
+        for (size_t y = 0; y < GLYPH_HEIGHT; y++) {
+            uint8_t bits = fbfont[ch][y / GLYPH_SCALE];
+            for (size_t x = 0; x < GLYPH_WIDTH; x++)
+                glyphs[ch][y][x] = (bits >> x) & 1 ? 0xffffffff : 0;
+        }
+    }
+}
+
+bool fbcon_init(struct multiboot_tag_framebuffer *tag)
+{
+    struct multiboot_tag_framebuffer_common *info = &tag->common;
+
+    if (info->framebuffer_type != MULTIBOOT_FRAMEBUFFER_TYPE_RGB ||
+            info->framebuffer_bpp != 32) {
+        printf("warn: fbcon: unsupported framebuffer (type %d, %d bpp)\n",
+            info->framebuffer_type, info->framebuffer_bpp);
+        return false;
+    }
+
+    if (info->framebuffer_addr > UINT32_MAX) {
+        printf("warn: fbcon: framebuffer above 4GiB\n");
+        return false;
+    }
+
+    uint32_t phys = info->framebuffer_addr;
+    uint32_t size = info->framebuffer_pitch * info->framebuffer_height;
+
+    fb = mem_map_range(K_MEM_DEV_START, phys, phys + size,
+        DEFAULT_PAGE_FLAGS | PG_WC);
+    if (!fb)
+        return false;
+
+    fb_stride = info->framebuffer_pitch / 4;
+    width = info->framebuffer_width;
+    height = info->framebuffer_height;
+    cols = width / GLYPH_WIDTH;
+    rows = height / GLYPH_HEIGHT;
+
+    back = malloc(width * height * sizeof(uint32_t));
+    glyphs = malloc(NUM_GLYPHS * sizeof(*glyphs));
+    uint16_t *new_cells = malloc(
+        NUM_VCONSOLES * cols * rows * sizeof(uint16_t));
+    if (!back || !glyphs || !new_cells) {
+        /* The consoles stay on VGA text mode. */
+        printf("warn: fbcon: no memory for a %ux%u console\n", cols, rows);
+        if (back)
+            free(back);
+        if (glyphs)
+            free(glyphs);
+        if (new_cells)
+            free(new_cells);
+        back = NULL;
+        glyphs = NULL;
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++)
+        palette[i] = make_color(vga_colors[i], tag);
+
+    render_glyphs();
+
+    /* Get rid of anything the bootloader left on screen. */
+    fill32(back, palette[0], width * height);
+    for (size_t y = 0; y < height; y++)
+        fill32(&fb[y * fb_stride], palette[0], width);
+
+    vconsole_set_backend(&fbcon_ops, new_cells, cols * rows, cols, rows);
+
+    printf("info: fbcon: %ux%u framebuffer at %08x, %ux%u console\n",
+        width, height, phys, cols, rows);
+    return true;
+}
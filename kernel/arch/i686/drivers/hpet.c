@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/drivers/hpet.c
+ *
+ * High Precision Event Timer. Only the main counter is used, as a clocksource
+ * and as the reference for TSC calibration. The comparators (timers) are left
+ * alone.
+ */
+
+#include <x86/hpet.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <ktime.h>
+#include <x86/acpi.h>
+#include <x86/mem.h>
+
+/* Registers */
+
+#define HPET_CAP 0x000
+#define HPET_CONFIG 0x010
+#define HPET_COUNTER 0x0f0
+
+#define CAP_COUNT_64BIT (1 << 13)
+#define CONFIG_ENABLE (1 << 0)
+
+/* The counter period is given in femtoseconds. */
+#define FSEC_PER_SEC 1000000000000000ULL
+
+static volatile uint32_t *regs;
+static uint64_t freq;
+
+uint64_t hpet_read()
+{
+    uint32_t hi, lo;
+
+    /* The high half may change between reading the halves. */
+    do {
+        hi = regs[HPET_COUNTER / 4 + 1];
+        lo = regs[HPET_COUNTER / 4];
+    } while (hi != regs[HPET_COUNTER / 4 + 1]);
+
+    return (uint64_t)hi << 32 | lo;
+}
+
+static uint64_t hpet_read32()
+{
+    return regs[HPET_COUNTER / 4];
+}
+
+uint64_t hpet_freq()
+{
+    return freq;
+}
+
+static struct clocksource hpet_clocksource = {
+    .name = "hpet",
+    .rating = 200,
+    .read = hpet_read,
+};
+
+bool hpet_init()
+{
+    const struct acpi_hpet *table = (const void *)acpi_find_table("HPET");
+    if (!table || table->base.space_id != 0 ||
+            table->base.address > UINT32_MAX)
+        return false;
+
+    uint32_t phys = table->base.address;
+    regs = mem_map_range(K_MEM_DEV_START, phys, phys + PAGE_SIZE,
+        DEFAULT_PAGE_FLAGS | PG_NCACHE);
+    if (!regs)
+        return false;
+
+    uint32_t cap = regs[HPET_CAP / 4];
+    uint32_t period = regs[HPET_CAP / 4 + 1];
+    if (!period) {
+        regs = NULL;
+        return false;
+    }
+    freq = FSEC_PER_SEC / period;
+
+    /* A 32-bit counter wraps every few minutes, which the clocksource layer
+     * can't deal with. Still good for calibration. */
+    bool wide = cap & CAP_COUNT_64BIT;
+    if (!wide)
+        hpet_clocksource.read = hpet_read32;
+
+    regs[HPET_CONFIG / 4] |= CONFIG_ENABLE;
+
+    printf("info: hpet: at %08x, %u kHz, %s counter\n", phys,
+        (uint32_t)(freq / 1000), wide ? "64-bit" : "32-bit");
+
+    if (wide)
+        clocksource_register(&hpet_clocksource);
+    return true;
+}
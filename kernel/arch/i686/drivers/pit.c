@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/drivers/pit.c
+ *
+ * 8253/8254 programmable interval timer, used for the tick if there is no
+ * local APIC timer.
+ * see also: kernel/include/timer.h
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <irq.h>
+#include <timer.h>
+#include <x86/pio.h>
+#include <x86/pit.h>
+
+#define IRQ0_PIT 0
+
+/* Ports */
+
+#define PIT_CH0 0x40
+#define PIT_CH2 0x42
+#define PIT_CMD 0x43
+
+/* Channel 2's gate and output are wired to the keyboard controller's port B
+ * (along with the speaker). */
+#define PORT_B 0x61
+#define PORT_B_GATE2 (1 << 0)
+#define PORT_B_SPEAKER (1 << 1)
+#define PORT_B_OUT2 (1 << 5)
+
+/* Mode/command register */
+
+#define PIT_SEL_CH0 (0 << 6)
+#define PIT_SEL_CH2 (2 << 6)
+#define PIT_ACCESS_LOHI (3 << 4)
+#define PIT_MODE_TERMINAL_COUNT (0 << 1)
+#define PIT_MODE_RATE (2 << 1)
+
+#define PIT_DIVISOR ((PIT_FREQ + HZ / 2) / HZ)
+
+_Static_assert(PIT_DIVISOR > 1 && PIT_DIVISOR <= 0x10000,
+    "HZ out of range for the PIT");
+
+static enum irq_return pit_irq(unsigned irq, void *data)
+{
+    (void)irq, (void)data;
+
+    timer_tick();
+    return IRQ_HANDLED;
+}
+
+static void pit_tick_periodic()
+{
+    /* Rate generator: one pulse every PIT_DIVISOR input clocks. A divisor of
+     * 0x10000 is written as 0. */
+    outb(PIT_CMD, PIT_SEL_CH0 | PIT_ACCESS_LOHI | PIT_MODE_RATE);
+    outb(PIT_CH0, (uint8_t)PIT_DIVISOR);
+    outb(PIT_CH0, (uint8_t)(PIT_DIVISOR >> 8));
+}
+
+static void pit_tick_oneshot(uint32_t ticks)
+{
+    /* Interrupt on terminal count: a single interrupt once it reaches 0. The
+     * counter is 16 bits, so that's at most max_ticks away. */
+    uint32_t count = ticks * PIT_DIVISOR;
+    if (count > 0xffff)
+        count = 0xffff;
+
+    outb(PIT_CMD, PIT_SEL_CH0 | PIT_ACCESS_LOHI | PIT_MODE_TERMINAL_COUNT);
+    outb(PIT_CH0, (uint8_t)count);
+    outb(PIT_CH0, (uint8_t)(count >> 8));
+}
+
+static const struct tick_device pit_tick = {
+    .name = "pit",
+    .periodic = pit_tick_periodic,
+    .oneshot = pit_tick_oneshot,
+    .max_ticks = 0xffff / PIT_DIVISOR,
+};
+
+void pit_init()
+{
+    pit_tick_periodic();
+    request_irq(IRQ0_PIT, pit_irq, NULL);
+    tick_set_device(&pit_tick);
+
+    printf("info: pit: %d Hz tick\n", HZ);
+}
+
+void pit_wait_us(uint32_t us)
+{
+    uint32_t count = PIT_FREQ / 1000 * us / 1000;
+    if (count > 0xffff)
+        count = 0xffff;
+
+    /* Gate on, speaker off. */
+    outb(PORT_B, (inb(PORT_B) & ~PORT_B_SPEAKER) | PORT_B_GATE2);
+
+    /* Output goes high once the count reaches zero. */
+    outb(PIT_CMD, PIT_SEL_CH2 | PIT_ACCESS_LOHI | PIT_MODE_TERMINAL_COUNT);
+    outb(PIT_CH2, (uint8_t)count);
+    outb(PIT_CH2, (uint8_t)(count >> 8));
+
+    while (!(inb(PORT_B) & PORT_B_OUT2))
+        ;
+}
@@ -6,10 +6,15 @@
 #include <stdio.h>
 
 #include <initcall.h>
+#include <irq.h>
+#include <irqflags.h>
+#include <softirq.h>
+#include <timer.h>
 #include <drivers/kb.h>
-#include <x86/interrupts.h>
 #include <x86/pio.h>
 
+#include "ring.h"
+
 #define IRQ1_KEYBOARD_DATA_READY 1
 
 /* Keyboard controller ports */
@@ -45,11 +50,15 @@
 /* Device commands (sent on the data port!) */
 
 #define PS2_KB_SETSCANCODESET 0xf0
+#define PS2_KB_ENABLE_SCANNING 0xf4
+#define PS2_KB_DISABLE_SCANNING 0xf5
 #define PS2_KB_RESET 0xff
 
 /* Device response */
 
 #define PS2_KB_SELF_TEST_PASSED 0xaa
+#define PS2_KB_SELF_TEST_FAILED1 0xfc
+#define PS2_KB_SELF_TEST_FAILED2 0xfd
 #define PS2_KB_ACK 0xfa
 #define PS2_KB_RESEND 0xfe
 
@@ -131,68 +140,66 @@ static uint8_t scs3_keycodes[256] = {
     0xff, 0xff, 0xff, 0xff
 };
 
+/* Scancodes not decoded yet. The interrupt handler produces, the softirq
+ * consumes. Must be a power of two. */
+#define RAW_QUEUE_LEN 64
+
+static RING(uint8_t, RAW_QUEUE_LEN) raw_queue;
+static uint32_t raw_dropped;
+
 static bool release_next;
 static uint8_t ignore_next;
 static uint8_t scancode_plane;
 
-static void wait_out(uint16_t port, uint8_t val)
-{
-    uint8_t status;
-    do {
-        status = inb(PS2_KB_STATUS);
-    } while (status & PS2_KB_INPUT_BUFFER_STATUS);
-    outb(port, val);
-}
-
-static uint8_t wait_in()
-{
-    uint8_t status;
-    do {
-        status = inb(PS2_KB_STATUS);
-    } while (!(status & PS2_KB_OUTPUT_BUFFER_STATUS));
-    return inb(PS2_KB_DATA);
-}
+/*
+ * Controller commands are answered within microseconds, so they are still
+ * polled, but only up to this many io_wait()s (about 1us each).
+ */
+#define PS2_POLL_LIMIT 100000
 
-static uint8_t send_dev_command1(uint8_t command)
+static bool wait_out(uint16_t port, uint8_t val)
 {
-    uint8_t status;
-    do {
-        wait_out(PS2_KB_DATA, command);
-        status = wait_in();
-    } while (status == PS2_KB_RESEND);
-    return status;
+    for (int i = 0; i < PS2_POLL_LIMIT; i++) {
+        if (!(inb(PS2_KB_STATUS) & PS2_KB_INPUT_BUFFER_STATUS)) {
+            outb(port, val);
+            return true;
+        }
+        io_wait();
+    }
+    return false;
 }
 
-static uint8_t send_dev_command2(uint8_t command, uint8_t arg)
+/* Returns the byte read, or -1 on timeout. */
+static int wait_in()
 {
-    if (send_dev_command1(command) != PS2_KB_ACK) {
-        printf("err: ps/2: first byte not ACKed: %02X %02X\n", command, arg);
+    for (int i = 0; i < PS2_POLL_LIMIT; i++) {
+        if (inb(PS2_KB_STATUS) & PS2_KB_OUTPUT_BUFFER_STATUS)
+            return inb(PS2_KB_DATA);
+        io_wait();
     }
-    return send_dev_command1(arg);
+    return -1;
 }
 
-static void cfg_set(uint8_t flag)
+static bool cfg_update(uint8_t clear, uint8_t set)
 {
-    wait_out(PS2_KB_CMD, PS2_KB_GETCONFIG);
-    uint8_t config = wait_in();
-    config |= flag;
-    wait_out(PS2_KB_CMD, PS2_KB_SETCONFIG);
-    wait_out(PS2_KB_DATA, config);
-}
+    if (!wait_out(PS2_KB_CMD, PS2_KB_GETCONFIG))
+        return false;
+    int config = wait_in();
+    if (config < 0)
+        return false;
 
-static void cfg_clear(uint8_t flag)
-{
-    wait_out(PS2_KB_CMD, PS2_KB_GETCONFIG);
-    uint8_t config = wait_in();
-    config &= ~flag;
-    wait_out(PS2_KB_CMD, PS2_KB_SETCONFIG);
-    wait_out(PS2_KB_DATA, config);
+    config = (config & ~clear) | set;
+    return wait_out(PS2_KB_CMD, PS2_KB_SETCONFIG) &&
+        wait_out(PS2_KB_DATA, config);
 }
 
 static bool controller_setup()
 {
     /* Self-test controller. */
-    wait_out(PS2_KB_CMD, PS2_KB_CONTROLLER_SELF_TEST);
+    if (!wait_out(PS2_KB_CMD, PS2_KB_CONTROLLER_SELF_TEST)) {
+        printf("err: ps/2: controller not responding\n");
+        return false;
+    }
     if (wait_in() != PS2_KB_CONTROLLER_SELF_TEST_PASSED) {
         printf("err: ps/2: controller self test failed\n");
         return false;
@@ -202,57 +209,226 @@ static bool controller_setup()
     wait_out(PS2_KB_CMD, PS2_KB_DISABLE1);
     wait_out(PS2_KB_CMD, PS2_KB_DISABLE2);
 
+    /* Drop anything the devices sent before. */
+    for (int i = 0; i < 16 && (inb(PS2_KB_STATUS) & PS2_KB_OUTPUT_BUFFER_STATUS);
+            i++)
+        inb(PS2_KB_DATA);
+
     /* Disable translation. By default, the keyboard controller translates from
      * the keyboard's native scancode set (usually 2) to set 1 for
-     * compatibility reasons. */
-    cfg_clear(PS2_KB_ENABLE_IRQ1 | PS2_KB_ENABLE_IRQ2 | PS2_KB_TRANSLATE);
-
-    /* Reset devices. */
-    uint8_t response = send_dev_command1(PS2_KB_RESET);
-    if (response != PS2_KB_ACK) {
-        printf("warn: ps/2: unable to reset devices\n");
-    } else if (wait_in() != PS2_KB_SELF_TEST_PASSED) {
-        printf("err: ps/2: device self test failed\n");
+     * compatibility reasons. The keyboard answers to our commands through
+     * IRQ1 from now on. */
+    if (!cfg_update(PS2_KB_ENABLE_IRQ2 | PS2_KB_TRANSLATE, PS2_KB_ENABLE_IRQ1)) {
+        printf("err: ps/2: unable to configure controller\n");
         return false;
     }
 
-    /* If supported, we want to use set 3, the most modern one and the only one
-     * with the reasonable stance of reporting both pressing and releasing on
-     * every key, including the Pause key. */
-    response = send_dev_command2(PS2_KB_SETSCANCODESET, 3);
-    if (response != PS2_KB_ACK) {
-        printf("warn: ps/2: unable to set scancode set\n");
+    /* Re-enable device port 1 (keyboard). */
+    return wait_out(PS2_KB_CMD, PS2_KB_ENABLE1);
+}
+
+/*
+ * Keyboard bring-up. Resetting the keyboard takes up to a second (and some
+ * emulated ones never answer), so it runs in the background: every command
+ * sent moves to the state waiting for its answer, the answers come in through
+ * IRQ1 and `kb_event()` sends the next command. `timeout` retries a command
+ * the keyboard didn't answer and eventually gives up.
+ */
+
+/* How long the keyboard may take to answer a command, and to finish its self
+ * test after a reset. */
+#define PS2_CMD_TIMEOUT_MS 100
+#define PS2_RESET_TIMEOUT_MS 1000
+
+/* Attempts per command (on timeout or RESEND) before giving up. */
+#define PS2_MAX_TRIES 3
+
+enum kb_state {
+    KB_OFFLINE,
+
+    KB_RESET,
+    KB_SELF_TEST,
+    KB_DISABLE_SCANNING,
+    KB_SET_SCS,
+    KB_SET_SCS_ARG,
+    KB_GET_SCS,
+    KB_GET_SCS_ARG,
+    KB_GET_SCS_RESULT,
+    KB_ENABLE_SCANNING,
+
+    KB_ONLINE,
+};
+
+static void kb_timeout(void *data);
+
+static enum kb_state state;
+static struct timer timeout = { .fn = kb_timeout };
+
+/* Command in progress, to start over with after a timeout. */
+static enum kb_state cmd_state;
+static uint8_t cmd_byte;
+static int tries;
+
+/* Last byte sent, to repeat on RESEND. */
+static uint8_t last_sent;
+
+static void give_up(const char *why)
+{
+    del_timer(&timeout);
+    state = KB_OFFLINE;
+    printf("err: ps/2: %s, keyboard will not be available\n", why);
+}
+
+static void arm_timeout()
+{
+    bool reset = state == KB_RESET || state == KB_SELF_TEST;
+    mod_timer(&timeout, jiffies + msecs_to_jiffies(
+        reset ? PS2_RESET_TIMEOUT_MS : PS2_CMD_TIMEOUT_MS));
+}
+
+static void transmit(uint8_t byte)
+{
+    last_sent = byte;
+    if (!wait_out(PS2_KB_DATA, byte)) {
+        give_up("controller not responding");
+        return;
     }
+    arm_timeout();
+}
 
-    /* Check if it worked. If it didn't, we just have to use whatever the
-     * keyboard supports, which SHOULD always be 2, but might be 1? */
-    response = send_dev_command2(PS2_KB_SETSCANCODESET, 0);
-    if (response != PS2_KB_ACK) {
-        printf("err: ps/2: failed to determine scancode set\n");
-        return false;
+/* Sends the first byte of a command. */
+static void start_command(enum kb_state next, uint8_t command)
+{
+    state = cmd_state = next;
+    cmd_byte = command;
+    tries = 1;
+    transmit(command);
+}
+
+/* Sends the argument of the command in progress. */
+static void send_arg(enum kb_state next, uint8_t arg)
+{
+    state = next;
+    transmit(arg);
+}
+
+/* Waits for more bytes answering the same command. */
+static void expect_more(enum kb_state next)
+{
+    state = next;
+    arm_timeout();
+}
+
+static void kb_timeout(void *data)
+{
+    (void)data;
+
+    if (state == KB_OFFLINE || state == KB_ONLINE)
+        return;
+
+    if (++tries > PS2_MAX_TRIES) {
+        give_up("no answer from keyboard");
+        return;
     }
-    scancode_set = wait_in();
-    if (scancode_set < 1 || scancode_set > 3) {
-        printf("err: ps/2: unknown scancode set: %d\n", scancode_set);
-        return false;
+
+    state = cmd_state;
+    transmit(cmd_byte);
+}
+
+static void kb_event(uint8_t byte)
+{
+    /* The keyboard didn't get the last byte right. */
+    if (byte == PS2_KB_RESEND && state != KB_GET_SCS_RESULT) {
+        if (++tries > PS2_MAX_TRIES)
+            give_up("keyboard keeps asking to resend");
+        else
+            transmit(last_sent);
+        return;
     }
-    printf("info: ps/2: using scancode set %d\n", scancode_set);
 
-    /* Re-enable IRQ1. */
-    cfg_set(PS2_KB_ENABLE_IRQ1);
+    /* Anything unexpected while waiting for an ACK is most likely a key
+     * pressed in the meantime, ignore it. */
+    switch (state) {
+    case KB_RESET:
+        if (byte == PS2_KB_ACK)
+            expect_more(KB_SELF_TEST);
+        break;
+
+    case KB_SELF_TEST:
+        if (byte == PS2_KB_SELF_TEST_PASSED)
+            start_command(KB_DISABLE_SCANNING, PS2_KB_DISABLE_SCANNING);
+        else if (byte == PS2_KB_SELF_TEST_FAILED1 ||
+                byte == PS2_KB_SELF_TEST_FAILED2)
+            give_up("device self test failed");
+        break;
 
-    /* Re-enable device port 1 (keyboard). */
-    wait_out(PS2_KB_CMD, PS2_KB_ENABLE1);
+    case KB_DISABLE_SCANNING:
+        /* If supported, we want to use set 3, the most modern one and the
+         * only one with the reasonable stance of reporting both pressing and
+         * releasing on every key, including the Pause key. */
+        if (byte == PS2_KB_ACK)
+            start_command(KB_SET_SCS, PS2_KB_SETSCANCODESET);
+        break;
+
+    case KB_SET_SCS:
+        if (byte == PS2_KB_ACK) {
+            send_arg(KB_SET_SCS_ARG, 3);
+        } else {
+            printf("warn: ps/2: unable to set scancode set\n");
+            start_command(KB_GET_SCS, PS2_KB_SETSCANCODESET);
+        }
+        break;
+
+    case KB_SET_SCS_ARG:
+        /* Check if it worked. If it didn't, we just have to use whatever the
+         * keyboard supports, which SHOULD always be 2, but might be 1? */
+        if (byte != PS2_KB_ACK)
+            printf("warn: ps/2: unable to set scancode set\n");
+        start_command(KB_GET_SCS, PS2_KB_SETSCANCODESET);
+        break;
+
+    case KB_GET_SCS:
+        if (byte == PS2_KB_ACK)
+            send_arg(KB_GET_SCS_ARG, 0);
+        else
+            give_up("failed to determine scancode set");
+        break;
 
-    printf("info: ps/2: setup successful\n");
-    return true;
+    case KB_GET_SCS_ARG:
+        if (byte == PS2_KB_ACK)
+            expect_more(KB_GET_SCS_RESULT);
+        else
+            give_up("failed to determine scancode set");
+        break;
+
+    case KB_GET_SCS_RESULT:
+        if (byte < 1 || byte > 3) {
+            printf("err: ps/2: unknown scancode set: %d\n", byte);
+            give_up("unusable scancode set");
+            break;
+        }
+        scancode_set = byte;
+        printf("info: ps/2: using scancode set %d\n", scancode_set);
+        start_command(KB_ENABLE_SCANNING, PS2_KB_ENABLE_SCANNING);
+        break;
+
+    case KB_ENABLE_SCANNING:
+        if (byte == PS2_KB_ACK) {
+            del_timer(&timeout);
+            state = KB_ONLINE;
+            printf("info: ps/2: keyboard online\n");
+        }
+        break;
+
+    case KB_OFFLINE:
+    case KB_ONLINE:
+        break;
+    }
 }
 
-INTERRUPT_HANDLER(ps2_key_pressed)()
+/* Turns one byte from the keyboard into key presses and releases. */
+static void decode(uint8_t scancode)
 {
-    uint8_t scancode;
-    scancode = inb(PS2_KB_DATA);
-
     switch (scancode_set)
     {
     case 3:
@@ -315,18 +491,53 @@ INTERRUPT_HANDLER(ps2_key_pressed)()
         printf("info: ps/2: scancode set not yet supported\n");
         break;
     }
+}
 
-    pic_eoi(IRQ1_KEYBOARD_DATA_READY);
+static void ps2_softirq()
+{
+    uint8_t scancode;
+    while (ring_pop(&raw_queue, &scancode)) {
+        if (state == KB_ONLINE)
+            decode(scancode);
+        else
+            kb_event(scancode);
+    }
+
+    if (raw_dropped) {
+        printf("warn: ps/2: dropped %u scancodes\n", raw_dropped);
+        raw_dropped = 0;
+    }
+}
+
+/* Only fetches the byte, everything else happens in `ps2_softirq()`. */
+static enum irq_return ps2_irq(unsigned irq, void *data)
+{
+    (void)irq, (void)data;
+
+    uint8_t scancode = inb(PS2_KB_DATA);
+
+    if (!ring_push(&raw_queue, scancode))
+        raw_dropped++;
+    raise_softirq(SOFTIRQ_KEYBOARD);
+
+    return IRQ_HANDLED;
 }
 
 void ps2_kb_driversetup()
 {
+    open_softirq(SOFTIRQ_KEYBOARD, ps2_softirq);
+
     if (!controller_setup()) {
         printf("FATAL: ps/2: keyboard will not be available\n");
         return;
     }
-    set_isr(IRQ_OFFSET + IRQ1_KEYBOARD_DATA_READY, int_ps2_key_pressed);
-    pic_clear_mask(IRQ1_KEYBOARD_DATA_READY);
+    request_irq(IRQ1_KEYBOARD_DATA_READY, ps2_irq, NULL);
+
+    /* The rest happens in the background, don't hold up booting. Answers
+     * must not be handled before we are done sending. */
+    irqflags_t flags = local_irq_save();
+    start_command(KB_RESET, PS2_KB_RESET);
+    local_irq_restore(flags);
 }
 
 initcall(ps2_kb_driversetup);
@@ -0,0 +1,426 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/drivers/serial.c
+ *
+ * 8250/16550A UART driver for the four IBM-PC COM ports. Writes go into a
+ * per-port transmit ring and are drained by the THRE (transmitter holding
+ * register empty) interrupt, one FIFO load at a time. Received bytes are
+ * collected into a receive ring by the interrupt handler.
+ * see also: kernel/include/drivers/tty.h
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+
+#include <atomic.h>
+#include <initcall.h>
+#include <irq.h>
+#include <irqflags.h>
+#include <timer.h>
+#include <drivers/tty.h>
+#include <x86/pio.h>
+
+#include "ring.h"
+#include "spinlock.h"
+#include "wait.h"
+
+#define NUM_PORTS 4
+
+#define IRQ3_COM2_COM4 3
+#define IRQ4_COM1_COM3 4
+
+/* Register offsets */
+
+#define UART_DATA 0 /* RBR (read), THR (write) */
+#define UART_IER 1
+#define UART_IIR 2 /* read */
+#define UART_FCR 2 /* write */
+#define UART_LCR 3
+#define UART_MCR 4
+#define UART_LSR 5
+#define UART_MSR 6
+#define UART_SCRATCH 7
+
+/* With LCR_DLAB set */
+#define UART_DLL 0
+#define UART_DLM 1
+
+/* Interrupt enable register */
+
+#define IER_RX_AVAILABLE (1 << 0)
+#define IER_THR_EMPTY (1 << 1)
+#define IER_LINE_STATUS (1 << 2)
+
+/* Interrupt identification register */
+
+#define IIR_NO_INT (1 << 0)
+#define IIR_ID_MASK 0x0e
+#define IIR_MODEM_STATUS 0x00
+#define IIR_THR_EMPTY 0x02
+#define IIR_RX_AVAILABLE 0x04
+#define IIR_LINE_STATUS 0x06
+#define IIR_RX_TIMEOUT 0x0c
+#define IIR_FIFO_MASK 0xc0
+#define IIR_FIFO_ENABLED 0xc0
+
+/* FIFO control register */
+
+#define FCR_ENABLE (1 << 0)
+#define FCR_CLEAR_RX (1 << 1)
+#define FCR_CLEAR_TX (1 << 2)
+#define FCR_TRIGGER_1 0x00
+#define FCR_TRIGGER_4 0x40
+#define FCR_TRIGGER_8 0x80
+#define FCR_TRIGGER_14 0xc0
+
+/* Line control register */
+
+#define LCR_8N1 0x03
+#define LCR_DLAB (1 << 7)
+
+/* Modem control register */
+
+#define MCR_DTR (1 << 0)
+#define MCR_RTS (1 << 1)
+#define MCR_OUT2 (1 << 3) /* gates the IRQ line on PCs */
+#define MCR_LOOPBACK (1 << 4)
+
+/* Line status register */
+
+#define LSR_DATA_READY (1 << 0)
+#define LSR_OVERRUN (1 << 1)
+#define LSR_THR_EMPTY (1 << 5)
+
+#define UART_CLOCK 115200
+#define BAUD_RATE 115200
+
+#define FIFO_SIZE 16
+
+/* A FIFO load takes about 1.4ms at 115200 baud. If the THRE interrupt for it
+ * hasn't come after this long, it got lost (which happens with some emulated
+ * and USB-attached UARTs), so we refill anyway. */
+#define TX_TIMEOUT_MS 50
+
+/* Ring sizes, must be powers of two. */
+#define TX_RING_SIZE 4096
+#define RX_RING_SIZE 1024
+
+struct serial_port {
+    uint16_t base;
+    uint8_t irq;
+    bool present;
+
+    /* Bytes the transmitter takes per THRE interrupt (1 without FIFO). */
+    uint8_t tx_burst;
+
+    /* Whether a THRE interrupt is still to come. If not, writers have to
+     * start transmission themselves. */
+    bool tx_busy;
+
+    uint32_t rx_dropped;
+    uint32_t overruns;
+    uint32_t tx_timeouts;
+
+    struct timer tx_watchdog;
+    struct wait_queue rx_wait;
+
+    /* Serializes writers producing into `tx` with whoever moves it into the
+     * UART (a writer, the interrupt handler or the watchdog), on any CPU. */
+    struct spinlock tx_lock;
+
+    /* Several threads may read the port, they take `rx_lock` to stay a
+     * single consumer of `rx`. */
+    struct spinlock rx_lock;
+
+    /* Writers produce into `tx`, the interrupt handler consumes. The other
+     * way around for `rx`, which only ever has one producer. */
+    RING(char, TX_RING_SIZE) tx;
+    RING(char, RX_RING_SIZE) rx;
+};
+
+static struct serial_port ports[NUM_PORTS] = {
+    { .base = 0x3f8, .irq = IRQ4_COM1_COM3 },
+    { .base = 0x2f8, .irq = IRQ3_COM2_COM4 },
+    { .base = 0x3e8, .irq = IRQ4_COM1_COM3 },
+    { .base = 0x2e8, .irq = IRQ3_COM2_COM4 },
+};
+
+/* The port kernel messages also go to, if any. Writing to it polls, which
+ * works anywhere (even before the driver is set up) and never drops output.
+ * `console_lock` serializes that with the interrupt-driven transmitter and
+ * with setting up the port. */
+static struct serial_port *console;
+static struct spinlock console_lock = SPINLOCK_INIT("serial_console");
+
+static struct serial_port *get_port(int port)
+{
+    if (port < 1 || port > NUM_PORTS || !ports[port - 1].present)
+        return NULL;
+    return &ports[port - 1];
+}
+
+/*
+ * Moves bytes from the transmit ring into the UART. Call with `p->tx_lock`
+ * held.
+ */
+static void tx_fill(struct serial_port *p)
+{
+    char buf[FIFO_SIZE];
+    size_t n = ring_read(&p->tx, buf, p->tx_burst);
+
+    if (p == console) {
+        irqflags_t flags = spin_lock_irqsave(&console_lock);
+
+        /* The console may have put something into the FIFO meanwhile. */
+        while (n && !(inb(p->base + UART_LSR) & LSR_THR_EMPTY))
+            cpu_relax();
+        for (size_t i = 0; i < n; i++)
+            outb(p->base + UART_DATA, buf[i]);
+
+        spin_unlock_irqrestore(&console_lock, flags);
+    } else {
+        for (size_t i = 0; i < n; i++)
+            outb(p->base + UART_DATA, buf[i]);
+    }
+
+    p->tx_busy = n > 0;
+
+    if (p->tx_busy)
+        mod_timer(&p->tx_watchdog, jiffies + msecs_to_jiffies(TX_TIMEOUT_MS));
+    else
+        del_timer(&p->tx_watchdog);
+}
+
+static void tx_timeout(void *data)
+{
+    struct serial_port *p = data;
+
+    irqflags_t flags = spin_lock_irqsave(&p->tx_lock);
+    if (p->tx_busy && (inb(p->base + UART_LSR) & LSR_THR_EMPTY)) {
+        p->tx_timeouts++;
+        tx_fill(p);
+    } else if (p->tx_busy) {
+        /* Still sending (flow control?), check again later. */
+        mod_timer(&p->tx_watchdog, jiffies + msecs_to_jiffies(TX_TIMEOUT_MS));
+    }
+    spin_unlock_irqrestore(&p->tx_lock, flags);
+}
+
+static void rx_drain(struct serial_port *p)
+{
+    uint8_t lsr;
+    bool received = false;
+
+    while ((lsr = inb(p->base + UART_LSR)) & LSR_DATA_READY) {
+        char ch = inb(p->base + UART_DATA);
+
+        if (lsr & LSR_OVERRUN)
+            p->overruns++;
+
+        if (ring_push(&p->rx, ch))
+            received = true;
+        else
+            p->rx_dropped++;
+    }
+
+    if (received)
+        wake_up(&p->rx_wait);
+}
+
+/* The line is shared between two ports, `data` is ours. */
+static enum irq_return serial_irq(unsigned irq, void *data)
+{
+    struct serial_port *p = data;
+    bool handled = false;
+    (void)irq;
+
+    /* Handle everything the port has to say. */
+    uint8_t iir;
+    while (!((iir = inb(p->base + UART_IIR)) & IIR_NO_INT)) {
+        handled = true;
+
+        switch (iir & IIR_ID_MASK) {
+        case IIR_RX_AVAILABLE:
+        case IIR_RX_TIMEOUT:
+        case IIR_LINE_STATUS:
+            rx_drain(p);
+            break;
+
+        case IIR_THR_EMPTY: {
+            /* Reading IIR acknowledged it already. */
+            irqflags_t flags = spin_lock_irqsave(&p->tx_lock);
+            tx_fill(p);
+            spin_unlock_irqrestore(&p->tx_lock, flags);
+            break;
+        }
+
+        case IIR_MODEM_STATUS:
+            inb(p->base + UART_MSR);
+            break;
+        }
+    }
+
+    return handled ? IRQ_HANDLED : IRQ_NONE;
+}
+
+int serial_read(int port, char *buf, size_t n)
+{
+    struct serial_port *p = get_port(port);
+    if (!p)
+        return -ENODEV;
+
+    irqflags_t flags = spin_lock_irqsave(&p->rx_lock);
+    int ret = ring_read(&p->rx, buf, n);
+    spin_unlock_irqrestore(&p->rx_lock, flags);
+    return ret;
+}
+
+struct wait_queue *serial_read_queue(int port)
+{
+    struct serial_port *p = get_port(port);
+    return p ? &p->rx_wait : NULL;
+}
+
+int serial_write(int port, const char *buf, size_t n)
+{
+    struct serial_port *p = get_port(port);
+    if (!p)
+        return -ENODEV;
+
+    /* Queue as much as fits. Never waits for the transmitter. Writers on any
+     * CPU or in interrupt handlers each queue their bytes in one piece, the
+     * lock keeps them from interleaving or racing the transmitter. */
+    irqflags_t flags = spin_lock_irqsave(&p->tx_lock);
+    size_t count = ring_write(&p->tx, buf, n);
+
+    /* Start transmission if the interrupt handler won't. */
+    if (count > 0 && !p->tx_busy)
+        tx_fill(p);
+    spin_unlock_irqrestore(&p->tx_lock, flags);
+
+    if (count == 0)
+        return n == 0 ? 0 : -EAGAIN;
+    return count;
+}
+
+static void console_putc(uint16_t base, char ch)
+{
+    while (!(inb(base + UART_LSR) & LSR_THR_EMPTY))
+        cpu_relax();
+    outb(base + UART_DATA, ch);
+}
+
+void serial_console_write(const char *buf, size_t n)
+{
+    struct serial_port *p = console;
+    if (!p)
+        return;
+
+    irqflags_t flags = spin_lock_irqsave(&console_lock);
+    for (size_t i = 0; i < n; i++) {
+        if (buf[i] == '\n')
+            console_putc(p->base, '\r');
+        console_putc(p->base, buf[i]);
+    }
+    spin_unlock_irqrestore(&console_lock, flags);
+}
+
+void serial_console_init(int port)
+{
+    if (port < 1 || port > NUM_PORTS)
+        return;
+
+    /* Just enough to send, the driver sets up the rest later. An absent
+     * port reads all ones, so the transmitter always looks ready. */
+    uint16_t base = ports[port - 1].base;
+    uint16_t divisor = UART_CLOCK / BAUD_RATE;
+    outb(base + UART_IER, 0);
+    outb(base + UART_LCR, LCR_DLAB);
+    outb(base + UART_DLL, (uint8_t)divisor);
+    outb(base + UART_DLM, (uint8_t)(divisor >> 8));
+    outb(base + UART_LCR, LCR_8N1);
+    outb(base + UART_FCR, FCR_ENABLE | FCR_CLEAR_TX);
+    outb(base + UART_MCR, MCR_DTR | MCR_RTS);
+
+    console = &ports[port - 1];
+}
+
+static bool port_probe(struct serial_port *p, bool *fifo)
+{
+    uint16_t base = p->base;
+
+    /* Nothing there if the scratch register doesn't hold a value. */
+    outb(base + UART_SCRATCH, 0x5a);
+    if (inb(base + UART_SCRATCH) != 0x5a)
+        return false;
+
+    outb(base + UART_IER, 0);
+
+    uint16_t divisor = UART_CLOCK / BAUD_RATE;
+    outb(base + UART_LCR, LCR_DLAB);
+    outb(base + UART_DLL, (uint8_t)divisor);
+    outb(base + UART_DLM, (uint8_t)(divisor >> 8));
+    outb(base + UART_LCR, LCR_8N1);
+
+    /* Check the port actually works by sending a byte to ourselves. */
+    outb(base + UART_MCR, MCR_LOOPBACK | MCR_RTS | MCR_DTR);
+    outb(base + UART_DATA, 0xae);
+    for (int i = 0; i < 1000 && !(inb(base + UART_LSR) & LSR_DATA_READY); i++)
+        io_wait();
+    if (inb(base + UART_DATA) != 0xae)
+        return false;
+
+    /* Receive interrupt after 14 bytes (or a timeout), so the handler runs
+     * about once per FIFO instead of once per byte. Only 16550As have
+     * (working) FIFOs, anything older will just not report them enabled. */
+    outb(base + UART_FCR,
+        FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX | FCR_TRIGGER_14);
+    *fifo = (inb(base + UART_IIR) & IIR_FIFO_MASK) == IIR_FIFO_ENABLED;
+    if (!*fifo)
+        outb(base + UART_FCR, 0);
+    p->tx_burst = *fifo ? FIFO_SIZE : 1;
+
+    /* Drop anything still pending. */
+    inb(base + UART_LSR);
+    inb(base + UART_DATA);
+    inb(base + UART_MSR);
+
+    outb(base + UART_MCR, MCR_DTR | MCR_RTS | MCR_OUT2);
+    outb(base + UART_IER, IER_RX_AVAILABLE | IER_THR_EMPTY | IER_LINE_STATUS);
+    return true;
+}
+
+static bool port_setup(struct serial_port *p)
+{
+    bool fifo;
+
+    /* Console output would mess up the loopback test. */
+    irqflags_t flags = spin_lock_irqsave(&console_lock);
+    bool found = port_probe(p, &fifo);
+    spin_unlock_irqrestore(&console_lock, flags);
+
+    if (found)
+        printf("info: serial: COM%d at %03x: %s\n",
+            (int)(p - ports) + 1, p->base, fifo ? "16550A" : "8250/16450");
+    return found;
+}
+
+void serial_driversetup()
+{
+    for (int i = 0; i < NUM_PORTS; i++) {
+        struct serial_port *p = &ports[i];
+
+        spin_lock_init(&p->tx_lock, "serial_tx");
+        spin_lock_init(&p->rx_lock, "serial_rx");
+        timer_setup(&p->tx_watchdog, tx_timeout, p);
+        p->present = port_setup(p);
+        if (p->present)
+            request_irq(p->irq, serial_irq, p);
+    }
+}
+
+initcall(serial_driversetup);
@@ -6,107 +6,363 @@
 #include <stdint.h>
 
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <bench.h>
 #include <initcall.h>
+#include <ktime.h>
+#include <spinlock.h>
 #include <x86/mem.h>
 #include <x86/pio.h>
+#include <x86/vconsole.h>
 
 #define VGA_WIDTH 80
 #define VGA_HEIGHT 25
-#define VGA_BUFFER_SIZE (VGA_WIDTH*VGA_HEIGHT)
+
+/* Text mode video memory is 32KiB, enough for 8 pages of 80x25 cells. The
+ * CRT controller shows whichever page the start address points at. */
+#define VGA_MEMORY 0xb8000
+#define VGA_PAGE_CELLS (PAGE_SIZE / 2)
 
 #define TAB_SIZE 8
 
 #define VGA_INDEX 0x3d4
 #define VGA_DATA 0x3d5
+#define VGA_START_HI 0x0c
+#define VGA_START_LO 0x0d
 #define VGA_CURSOR_LO 0x0f
 #define VGA_CURSOR_HI 0x0e
 
-static uint8_t format = 0x07;
+#define BENCH_LINE "The quick brown fox jumps over the lazy dog. 0123456789 " \
+    "!\"#$%&'()*+,-./:;<=>?@[]\n"
+#define BENCH_LINES 2000
+
+/*
+ * Each console's lock covers its own state and, while it's in the foreground,
+ * the backend and the dirty range too. Writers may be on any CPU or in
+ * interrupt handlers. Switching consoles and backends takes all the locks, so
+ * `fg`, `ops` and the dimensions don't change under any of their holders.
+ */
+struct vconsole {
+    struct spinlock lock;
+    uint16_t *cells;
+    size_t pos;
+    uint8_t format;
+    bool processing_sequence;
+};
+
+static struct vconsole vconsoles[NUM_VCONSOLES] = {
+    [0 ... NUM_VCONSOLES - 1] = { .lock = SPINLOCK_INIT("vconsole") },
+};
+
+/* The console on screen. Only this one talks to the backend, all others just
+ * write to their cell buffer. */
+static struct vconsole *fg = &vconsoles[0];
+
 static uint16_t *vga_buffer;
-static size_t pos = 0;
 
-static bool processing_sequence;
+/* Cell buffer dimensions of the current backend. */
+static size_t cols = VGA_WIDTH, rows = VGA_HEIGHT;
+static size_t stride = VGA_PAGE_CELLS;
+static const struct vconsole_ops *ops;
+
+/* Cells of the foreground console changed since the last flush. */
+static size_t dirty_start, dirty_end;
+
 int num_par;
 
-static void tty_scroll(int lines)
+/* Offset of the displayed page in video memory (cells). */
+static size_t vga_start;
+
+static void vga_draw(const uint16_t *cells, size_t start, size_t end)
 {
-    int points = lines * VGA_WIDTH;
-    int bytes = points * 2;
-    memmove(vga_buffer, &vga_buffer[points], VGA_BUFFER_SIZE * 2 - bytes);
-    memset(&vga_buffer[VGA_BUFFER_SIZE - points], 0, bytes);
-    pos -= points;
+    /* Cells are written to video memory directly. */
+    (void)cells;
+    (void)start;
+    (void)end;
 }
 
-static void tty_set_cursor(size_t pos)
+static void vga_scroll(size_t lines)
 {
+    (void)lines;
+}
+
+static void vga_flush(size_t pos)
+{
+    /* The cursor position counts from the start of video memory, not from
+     * the start of the displayed page. */
+    pos += vga_start;
     outb(VGA_INDEX, VGA_CURSOR_LO);
     outb(VGA_DATA, (uint8_t)pos);
     outb(VGA_INDEX, VGA_CURSOR_HI);
     outb(VGA_DATA, (uint8_t)(pos >> 8));
 }
 
-static void tty_putchar(char ch)
+static void vga_show(const uint16_t *cells)
+{
+    vga_start = cells - vga_buffer;
+    outb(VGA_INDEX, VGA_START_LO);
+    outb(VGA_DATA, (uint8_t)vga_start);
+    outb(VGA_INDEX, VGA_START_HI);
+    outb(VGA_DATA, (uint8_t)(vga_start >> 8));
+}
+
+static const struct vconsole_ops vga_ops = {
+    .draw = vga_draw,
+    .scroll = vga_scroll,
+    .flush = vga_flush,
+    .show = vga_show,
+};
+
+/* In index order, so two of these can't deadlock. */
+static void lock_all(irqflags_t flags[NUM_VCONSOLES])
+{
+    for (int i = 0; i < NUM_VCONSOLES; i++)
+        flags[i] = spin_lock_irqsave(&vconsoles[i].lock);
+}
+
+static void unlock_all(irqflags_t flags[NUM_VCONSOLES])
+{
+    for (int i = NUM_VCONSOLES - 1; i >= 0; i--)
+        spin_unlock_irqrestore(&vconsoles[i].lock, flags[i]);
+}
+
+static void mark_dirty(struct vconsole *vc, size_t start, size_t end)
+{
+    if (vc != fg)
+        return;
+    if (dirty_start >= dirty_end) {
+        dirty_start = start;
+        dirty_end = end;
+        return;
+    }
+    dirty_start = start < dirty_start ? start : dirty_start;
+    dirty_end = end > dirty_end ? end : dirty_end;
+}
+
+static void tty_scroll(struct vconsole *vc, size_t lines)
 {
+    size_t size = cols * rows;
+    size_t points = lines * cols;
+    memmove(vc->cells, &vc->cells[points], (size - points) * 2);
+    memset(&vc->cells[size - points], 0, points * 2);
+    vc->pos -= points;
+
+    if (vc != fg)
+        return;
+
+    ops->scroll(lines);
+
+    /* Cells not drawn yet moved up as well. */
+    if (dirty_end > points) {
+        dirty_start = dirty_start > points ? dirty_start - points : 0;
+        dirty_end -= points;
+    } else {
+        dirty_start = dirty_end = 0;
+    }
+}
+
+static void tty_putchar(struct vconsole *vc, char ch)
+{
+    size_t size = cols * rows;
+
     switch (ch) {
     case '\n': /* Newline */
     case '\r': /* Carriage Return (^M) */
-        pos = (pos / VGA_WIDTH + 1) * VGA_WIDTH;
+        vc->pos = (vc->pos / cols + 1) * cols;
         break;
 
     case '\t': /* Tab */
-        pos = (pos / TAB_SIZE + 1) * TAB_SIZE;
+        vc->pos = (vc->pos / TAB_SIZE + 1) * TAB_SIZE;
         break;
     
     case '\f': /* Form Feed (^L, Clear Screen) */
-        memset(vga_buffer, 0, VGA_BUFFER_SIZE * 2);
-        pos = 0;
+        memset(vc->cells, 0, size * 2);
+        mark_dirty(vc, 0, size);
+        vc->pos = 0;
         break;
     
     case '\e': /* Escape (^[, Begin ANSI escape sequence) */
-        processing_sequence = true;
+        vc->processing_sequence = true;
         break;
 
     default:
-        vga_buffer[pos] = (uint16_t)format << 8 | ch;
-        pos++;
+        vc->cells[vc->pos] = (uint16_t)vc->format << 8 | (uint8_t)ch;
+        mark_dirty(vc, vc->pos, vc->pos + 1);
+        vc->pos++;
     }
     
-    if (pos >= VGA_BUFFER_SIZE) {
-        int lines = (pos - VGA_BUFFER_SIZE) / VGA_WIDTH + 1;
-        tty_scroll(lines);
+    if (vc->pos >= size) {
+        size_t lines = (vc->pos - size) / cols + 1;
+        tty_scroll(vc, lines);
     }
 }
 
 void tty_init()
 {
-    /* Virtual console VGA display. */
-    vga_buffer = mem_map(K_MEM_DEV_START, 1, 0xb8000, DEFAULT_PAGE_FLAGS);
+    /* Virtual console VGA display, one page per console. */
+    vga_buffer = mem_map(K_MEM_DEV_START, NUM_VCONSOLES, VGA_MEMORY,
+        DEFAULT_PAGE_FLAGS);
+
+    /* The first page is what the bootloader left us, keep it. */
+    memset(&vga_buffer[VGA_PAGE_CELLS], 0,
+        (NUM_VCONSOLES - 1) * VGA_PAGE_CELLS * 2);
+
+    for (int i = 0; i < NUM_VCONSOLES; i++) {
+        vconsoles[i].cells = &vga_buffer[i * VGA_PAGE_CELLS];
+        vconsoles[i].format = 0x07;
+    }
+
+    ops = &vga_ops;
+    ops->show(fg->cells);
 }
 
-int vconsole_write(const char *buf, size_t n)
+void vconsole_set_backend(const struct vconsole_ops *new_ops,
+        uint16_t *new_cells, size_t new_stride, size_t new_cols,
+        size_t new_rows)
 {
-    for (size_t i = 0; i < n; i++)
-        tty_putchar(*(buf++));
-    tty_set_cursor(pos);
-    return n;
+    irqflags_t flags[NUM_VCONSOLES];
+    lock_all(flags);
+
+    for (int i = 0; i < NUM_VCONSOLES; i++) {
+        struct vconsole *vc = &vconsoles[i];
+        uint16_t *dest = &new_cells[i * new_stride];
+
+        if (dest == vc->cells)
+            continue;
+
+        memset(dest, 0, new_cols * new_rows * 2);
+
+        /* Keep the bottom of the old screen, which has the latest output. */
+        size_t used = vc->pos / cols + 1;
+        size_t keep = used < new_rows ? used : new_rows;
+        size_t width = cols < new_cols ? cols : new_cols;
+        for (size_t row = 0; row < keep; row++)
+            memcpy(&dest[row * new_cols],
+                &vc->cells[(used - keep + row) * cols], width * 2);
+
+        size_t col = vc->pos % cols;
+        vc->pos = (keep - 1) * new_cols + (col < width ? col : 0);
+        vc->cells = dest;
+    }
+
+    cols = new_cols;
+    rows = new_rows;
+    stride = new_stride;
+    ops = new_ops;
+
+    dirty_start = dirty_end = 0;
+    ops->show(fg->cells);
+    ops->flush(fg->pos);
+
+    unlock_all(flags);
 }
 
-int serial_read(int port, char *buf, size_t n)
+int vconsole_foreground()
 {
-    /* TODO */
-    return 0;
+    return fg - vconsoles;
 }
 
-int serial_write(int port, const char *buf, size_t n)
+void vconsole_switch(int n)
 {
-    /* IBM-PC COM ports */
-    static int ports[] = { 0x3f8, 0x2f8 };
-    /* TODO: Support more ports */
-    if (port > 2)
+    if (n < 0 || n >= NUM_VCONSOLES)
+        return;
+
+    irqflags_t flags[NUM_VCONSOLES];
+    lock_all(flags);
+
+    if (&vconsoles[n] == fg) {
+        unlock_all(flags);
+        return;
+    }
+
+    /* Whatever is still pending belongs to the old console. */
+    if (dirty_start < dirty_end)
+        ops->draw(fg->cells, dirty_start, dirty_end);
+    dirty_start = dirty_end = 0;
+
+    fg = &vconsoles[n];
+    ops->show(fg->cells);
+    ops->flush(fg->pos);
+
+    unlock_all(flags);
+}
+
+int vconsole_write(int n, const char *buf, size_t len)
+{
+    if (n == VC_FOREGROUND)
+        n = vconsole_foreground();
+    if (n < 0 || n >= NUM_VCONSOLES)
         return -ENODEV;
-    for (size_t i = 0; i < n; i++)
-        outb(ports[port - 1], *(buf++));
-    return n;
+
+    struct vconsole *vc = &vconsoles[n];
+
+    /* Output of different writers doesn't interleave within one call. */
+    irqflags_t flags = spin_lock_irqsave(&vc->lock);
+
+    for (size_t i = 0; i < len; i++)
+        tty_putchar(vc, *(buf++));
+
+    if (vc == fg) {
+        if (dirty_start < dirty_end)
+            ops->draw(vc->cells, dirty_start, dirty_end);
+        dirty_start = dirty_end = 0;
+        ops->flush(vc->pos);
+    }
+
+    spin_unlock_irqrestore(&vc->lock, flags);
+    return len;
+}
+
+int console_write(const char *buf, size_t n)
+{
+    serial_console_write(buf, n);
+    return vconsole_write(0, buf, n);
+}
+
+/* Returns characters per second. */
+static uint64_t bench_backend(int n)
+{
+    size_t len = strlen(BENCH_LINE);
+    uint64_t start = ktime_get_ns();
+    for (int i = 0; i < BENCH_LINES; i++)
+        vconsole_write(n, BENCH_LINE, len);
+    uint64_t ns = ktime_get_ns() - start;
+    return (uint64_t)len * BENCH_LINES * NSEC_PER_SEC / (ns ? ns : 1);
 }
+
+/* Writes a fixed amount of text through every available backend, reports
+ * characters per second. */
+static void vconsole_bench()
+{
+    const struct vconsole_ops *saved_ops = ops;
+    uint16_t *saved_cells = vconsoles[0].cells;
+    size_t saved_stride = stride, saved_cols = cols, saved_rows = rows;
+
+    /* Output to a console in the background only touches its cells. */
+    int bg = vconsole_foreground() == 0 ? 1 : 0;
+    uint64_t text = 0, fb = 0, background = bench_backend(bg);
+
+    if (saved_ops != &vga_ops) {
+        vconsole_set_backend(&vga_ops, vga_buffer, VGA_PAGE_CELLS,
+            VGA_WIDTH, VGA_HEIGHT);
+        text = bench_backend(VC_FOREGROUND);
+        vconsole_set_backend(saved_ops, saved_cells, saved_stride, saved_cols,
+            saved_rows);
+        fb = bench_backend(VC_FOREGROUND);
+    } else {
+        text = bench_backend(VC_FOREGROUND);
+    }
+
+    /* Clear the screen the benchmark filled, so the results stay visible. */
+    printf("\f");
+    bench_report("vconsole.text", text, "chars/s", BENCH_HIGHER_IS_BETTER);
+    if (fb)
+        bench_report("vconsole.framebuffer", fb, "chars/s",
+            BENCH_HIGHER_IS_BETTER);
+    bench_report("vconsole.background", background, "chars/s",
+        BENCH_HIGHER_IS_BETTER);
+}
+
+BENCHMARK_RUN(vconsole, vconsole_bench);
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/atomic.h
+ *
+ * Atomic read-modify-write operations. All of them are full barriers (locked
+ * instructions are on x86).
+ * see also: kernel/arch/i686/include/barrier.h
+ */
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sets `*p` to `new` if it is `old`. Returns whether it did. */
+static inline bool cmpxchg(volatile uint32_t *p, uint32_t old, uint32_t new)
+{
+    bool ok;
+    asm volatile ("lock; cmpxchgl %3, %1\n\tsete %0"
+        : "=q"(ok), "+m"(*p), "+a"(old) : "r"(new) : "memory", "cc");
+    return ok;
+}
+
+/* Adds `v` to `*p`, returns the previous value. */
+static inline uint32_t atomic_fetch_add(volatile uint32_t *p, uint32_t v)
+{
+    asm volatile ("lock; xaddl %0, %1"
+        : "+r"(v), "+m"(*p) :: "memory", "cc");
+    return v;
+}
+
+static inline void atomic_or(volatile uint32_t *p, uint32_t v)
+{
+    asm volatile ("lock; orl %1, %0" : "+m"(*p) : "r"(v) : "memory", "cc");
+}
+
+static inline void atomic_and(volatile uint32_t *p, uint32_t v)
+{
+    asm volatile ("lock; andl %1, %0" : "+m"(*p) : "r"(v) : "memory", "cc");
+}
+
+/* For spin loops: saves power and leaves the core to a hyperthread sibling. */
+static inline void cpu_relax(void)
+{
+    asm volatile ("pause" ::: "memory");
+}
+
+#endif
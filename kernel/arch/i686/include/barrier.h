@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/barrier.h
+ *
+ * Memory ordering primitives. x86 only ever reorders stores with later loads,
+ * so acquire and release semantics come for free as long as the compiler
+ * keeps the accesses in program order.
+ */
+#ifndef BARRIER_H
+#define BARRIER_H
+
+/* Keeps the compiler from moving memory accesses across this point. */
+#define barrier() asm volatile ("" ::: "memory")
+
+/* Full barrier, also orders stores before later loads. */
+#define smp_mb() asm volatile ("lock; addl $0, (%%esp)" ::: "memory", "cc")
+
+#define smp_rmb() barrier()
+#define smp_wmb() barrier()
+
+/* Loads `*p`. No later memory access is moved before it. */
+#define smp_load_acquire(p) ({ \
+        __typeof__(*(p)) __v = *(volatile __typeof__(*(p)) *)(p); \
+        barrier(); \
+        __v; \
+    })
+
+/* Stores `v` to `*p`. No earlier memory access is moved after it. */
+#define smp_store_release(p, v) do { \
+        barrier(); \
+        *(volatile __typeof__(*(p)) *)(p) = (v); \
+    } while (0)
+
+#endif
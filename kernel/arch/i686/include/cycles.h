@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+
+#include <x86/cpu.h>
+
+/*
+ * Free-running CPU cycle counter, for measuring short durations. Not
+ * calibrated, not synchronized between CPUs.
+ */
+static inline uint64_t get_cycles(void)
+{
+    return rdtsc();
+}
+
+#endif
@@ -1,10 +1,49 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/initcall.h
+ *
+ * Functions run once at boot, after the core of the kernel (memory,
+ * interrupts, timers, the scheduler) is up. Each one leaves a descriptor in
+ * the `.initcall.<level>` section, which the linker script collects in level
+ * order. Levels run one after another, but the initcalls within a level run
+ * in parallel, each in its own thread, so one waiting on slow hardware doesn't
+ * hold up the others.
+ *
+ *  - early: what the other initcalls rely on, or should be measured by
+ *  - core: kernel subsystems and their threads
+ *  - device: drivers (what `initcall()` means)
+ *  - late: what needs the drivers
+ *
+ * see also: kernel/initcall.c
+ */
 #ifndef INITCALL_H
 #define INITCALL_H
 
-#define initcall(func) \
-    asm(".section .initcall\n" \
-        ".long "#func"\n" \
-        ".previous")
+#include <stdint.h>
+
+typedef void (*initcall_f)(void);
+
+struct initcall {
+    initcall_f fn;
+    const char *name;
+    uint64_t cycles; /* how long it took, set at boot */
+} __attribute__((aligned(4)));
+
+#define __define_initcall(func, level) \
+    static struct initcall __initcall_##func \
+        __attribute__((used, section(".initcall." #level))) = \
+        { func, #func, 0 }
+
+#define early_initcall(func) __define_initcall(func, early)
+#define core_initcall(func) __define_initcall(func, core)
+#define device_initcall(func) __define_initcall(func, device)
+#define late_initcall(func) __define_initcall(func, late)
+
+#define initcall(func) device_initcall(func)
+
+/**
+ * @brief Runs all initcalls, level by level, then prints how long they took
+ */
+void do_initcalls(void);
 
 #endif
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef IRQFLAGS_H
+#define IRQFLAGS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <irqsoff.h>
+
+#define EFLAGS_IF (1 << 9)
+
+typedef uint32_t irqflags_t;
+
+/* Every change is reported to the latency tracer, see irqsoff.h. */
+
+static inline void local_irq_disable(void)
+{
+    asm volatile ("cli" ::: "memory");
+    trace_hardirqs_off();
+}
+
+static inline void local_irq_enable(void)
+{
+    trace_hardirqs_on();
+    asm volatile ("sti" ::: "memory");
+}
+
+/* Disables interrupts. Returns the previous flags for `local_irq_restore()`. */
+static inline irqflags_t local_irq_save(void)
+{
+    irqflags_t flags;
+    asm volatile ("pushfl\n\tpopl %0\n\tcli" : "=r"(flags) :: "memory");
+    if (flags & EFLAGS_IF)
+        trace_hardirqs_off();
+    return flags;
+}
+
+static inline void local_irq_restore(irqflags_t flags)
+{
+    if (flags & EFLAGS_IF)
+        local_irq_enable();
+}
+
+/*
+ * Enables interrupts and halts until the next one, with no window for an
+ * interrupt to slip in between (`sti` takes effect after the next
+ * instruction). Returns with interrupts enabled, after the handler ran.
+ */
+static inline void arch_safe_halt(void)
+{
+    trace_hardirqs_on();
+    asm volatile ("sti\n\thlt" ::: "memory");
+}
+
+static inline bool irqs_disabled(void)
+{
+    irqflags_t flags;
+    asm volatile ("pushfl\n\tpopl %0" : "=r"(flags));
+    return !(flags & EFLAGS_IF);
+}
+
+#endif
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/percpu.h
+ *
+ * Per-CPU data. Every CPU has its own `struct cpu`, and its own GDT with a
+ * segment covering just that structure, loaded into %gs. So `%gs:0` is always
+ * the running CPU's structure, without having to ask the APIC who we are.
+ * see also: kernel/arch/i686/smp.c
+ */
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <x86/apic.h>
+
+#define NR_CPUS MAX_CPUS
+
+/* Segment selectors, the first five match the boot GDT in boot0.s. */
+#define GDT_K_CODE 0x08
+#define GDT_K_DATA 0x10
+#define GDT_U_CODE 0x18
+#define GDT_U_DATA 0x20
+#define GDT_TSS 0x28
+#define GDT_PERCPU 0x30
+
+#define GDT_ENTRIES 7
+
+/* Stack of the CPUs started after the boot CPU */
+#define CPU_STACK_SIZE 8192
+
+struct tss {
+    uint32_t link;
+    uint32_t esp0, ss0;
+    uint32_t esp1, ss1;
+    uint32_t esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap, iomap_base;
+} __attribute__((packed));
+
+struct registers;
+
+struct cpu {
+    struct cpu *self; /* at %gs:0 */
+    unsigned id; /* 0 is the boot CPU */
+    uint8_t apic_id;
+    volatile bool online;
+
+    void *stack_top;
+
+    /* Registers saved on entry to the IRQ being handled, or NULL */
+    struct registers *irq_regs;
+
+    uint64_t gdt[GDT_ENTRIES];
+    struct tss tss;
+};
+
+/* Indexed by `id` */
+extern struct cpu cpus[NR_CPUS];
+
+static inline struct cpu *this_cpu(void)
+{
+    struct cpu *cpu;
+    asm volatile ("movl %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+static inline unsigned smp_processor_id(void)
+{
+    unsigned id;
+    asm volatile ("movl %%gs:%c1, %0"
+        : "=r"(id) : "i"(offsetof(struct cpu, id)));
+    return id;
+}
+
+/* What the current IRQ interrupted (NULL outside IRQ handlers) */
+static inline struct registers *get_irq_regs(void)
+{
+    return this_cpu()->irq_regs;
+}
+
+/* Returns the previous value, to restore when the IRQ is done. */
+static inline struct registers *set_irq_regs(struct registers *regs)
+{
+    struct cpu *cpu = this_cpu();
+    struct registers *old = cpu->irq_regs;
+    cpu->irq_regs = regs;
+    return old;
+}
+
+/* CPUs that finished starting up, numbered 0..num_online_cpus()-1. */
+unsigned num_online_cpus(void);
+
+/* Interrupts `cpu` (out of `hlt`), which then calls `work_kick()`. */
+void smp_send_wake(unsigned cpu);
+
+/* Makes `cpu` record a profiling sample, see kernel/include/profile.h */
+void smp_send_profile(unsigned cpu);
+
+#endif
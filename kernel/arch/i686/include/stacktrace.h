@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/stacktrace.h
+ *
+ * Stack traces by walking the frame pointer chain: every function (the kernel
+ * is built with frame pointers) pushes %ebp below its return address and
+ * points %ebp there, so each frame links to its caller's. The chain ends at a
+ * null %ebp, which the boot code and new threads start out with.
+ * see also: kernel/arch/i686/stacktrace.c
+ */
+#ifndef STACKTRACE_H
+#define STACKTRACE_H
+
+struct registers;
+
+struct stack_frame {
+    struct stack_frame *next; /* the caller's frame */
+    void *ret;
+};
+
+/*
+ * Stores up to `max` return addresses, starting with the one the caller
+ * returns to. Returns how many.
+ */
+unsigned stack_trace(void **entries, unsigned max);
+
+/*
+ * Like `stack_trace()`, for the code interrupted with `regs`: starts with the
+ * interrupted instruction.
+ */
+unsigned stack_trace_regs(const struct registers *regs, void **entries,
+        unsigned max);
+
+#endif
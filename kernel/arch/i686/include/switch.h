@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include <stdint.h>
+
+/*
+ * Saves the callee-saved registers on the current stack, stores the stack
+ * pointer to `*old_sp`, then continues on `new_sp` where another
+ * `switch_stack()` call (or `stack_init()`) left off.
+ * Defined in switch.s.
+ */
+void switch_stack(void **old_sp, void *new_sp);
+
+/*
+ * Prepares a new stack ending at `top` for `switch_stack()`, which will "return"
+ * to `entry`. Returns the initial stack pointer.
+ */
+static inline void *stack_init(void *top, void (*entry)(void))
+{
+    uint32_t *sp = top;
+
+    *--sp = 0; /* fake return address of `entry` */
+    *--sp = (uint32_t)entry;
+    *--sp = 0; /* ebp */
+    *--sp = 0; /* ebx */
+    *--sp = 0; /* esi */
+    *--sp = 0; /* edi */
+    return sp;
+}
+
+#endif
@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/x86/acpi.h
+ *
+ * ACPI table discovery. Only the static tables are used (no AML), and only
+ * what the kernel needs from them is declared here.
+ */
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vendor/grub/multiboot2.h>
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+
+    /* Revision 2 and later */
+    uint32_t length;
+    uint64_t xsdt_addr;
+    uint8_t ext_checksum;
+    uint8_t _resv[3];
+} __attribute__((packed));
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+/* Multiple APIC Description Table ("APIC") */
+
+#define MADT_PCAT_COMPAT (1 << 0) /* also has 8259s */
+
+enum madt_entry_type {
+    MADT_LAPIC = 0,
+    MADT_IOAPIC = 1,
+    MADT_INT_OVERRIDE = 2,
+    MADT_LAPIC_NMI = 4,
+    MADT_LAPIC_ADDR = 5,
+};
+
+struct acpi_madt {
+    struct acpi_sdt_header header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+#define MADT_LAPIC_ENABLED (1 << 0)
+#define MADT_LAPIC_ONLINE_CAPABLE (1 << 1)
+
+struct madt_lapic {
+    struct madt_entry entry;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    struct madt_entry entry;
+    uint8_t id;
+    uint8_t _resv;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+/* Interrupt source override flags (MPS INTI flags) */
+#define MADT_POLARITY_MASK 0x3
+#define MADT_POLARITY_LOW 0x3
+#define MADT_TRIGGER_MASK 0xc
+#define MADT_TRIGGER_LEVEL 0xc
+
+struct madt_int_override {
+    struct madt_entry entry;
+    uint8_t bus; /* always 0 (ISA) */
+    uint8_t source;
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct madt_lapic_addr {
+    struct madt_entry entry;
+    uint16_t _resv;
+    uint64_t addr;
+} __attribute__((packed));
+
+/* HPET Description Table ("HPET") */
+
+/* Generic address structure */
+struct acpi_gas {
+    uint8_t space_id; /* 0 = memory */
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __attribute__((packed));
+
+struct acpi_hpet {
+    struct acpi_sdt_header header;
+    uint32_t block_id;
+    struct acpi_gas base;
+    uint8_t number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed));
+
+/*
+ * Finds the ACPI tables through the RSDP copy GRUB passed us (the ACPI_OLD or
+ * ACPI_NEW tag) and maps them. Needs the memory maps, so call after the
+ * memory manager is set up.
+ */
+void acpi_init(struct multiboot_tag *tag);
+
+/*
+ * Returns the table with the signature `sig` (e.g. "APIC"), or NULL if the
+ * firmware doesn't have it (or there is no ACPI at all).
+ */
+const struct acpi_sdt_header *acpi_find_table(const char *sig);
+
+#endif
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/x86/apic.h
+ *
+ * Local APIC and I/O APIC. When the MADT lists them, they replace the 8259s:
+ * IRQ lines 0-15 are the ISA IRQs (wherever the MADT says they are connected),
+ * 16-23 the remaining I/O APIC inputs, and the local APIC's own interrupts
+ * come after that.
+ * see also: kernel/include/irq.h
+ */
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* IRQ lines going through an I/O APIC. */
+#define NR_IOAPIC_IRQS 24
+
+#define IRQ_LAPIC_TIMER 24
+
+/* Local APIC spurious interrupt vector. */
+#define APIC_SPURIOUS_VECTOR 0xff
+
+#define MAX_CPUS 16
+
+/*
+ * Sets up the local APIC and I/O APICs found in the MADT and makes them the
+ * IRQ chip. Returns false (and leaves the 8259s alone) if there is no usable
+ * APIC.
+ */
+bool apic_init(void);
+
+/*
+ * Starts the local APIC timer as the periodic tick, after calibrating it
+ * against the PIT. Returns false if there is no local APIC.
+ */
+bool lapic_timer_init(void);
+
+/* Enables the calling CPU's local APIC, for CPUs started after the boot CPU.
+ * They get no device interrupts, the I/O APICs deliver to the boot CPU. */
+void lapic_ap_init(void);
+
+/*
+ * Starts another CPU: INIT resets it, then a startup IPI (twice, by the book)
+ * has it run real mode code at `phys`, which must be page aligned and below
+ * 1 MiB.
+ */
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint32_t phys);
+
+/* Sends interrupt `vector` to another CPU. Its handler has to call
+ * `lapic_eoi()`. */
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+void lapic_eoi(void);
+
+/* APIC ID of the calling CPU. */
+uint8_t lapic_id(void);
+
+/* Number of CPUs listed in the MADT, and their APIC IDs. */
+unsigned apic_num_cpus(void);
+uint8_t apic_cpu_id(unsigned cpu);
+
+#endif
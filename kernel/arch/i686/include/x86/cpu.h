@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+/* CPUID leaf 1, %edx feature flags */
+#define CPUID_1_EDX_TSC (1 << 4)
+#define CPUID_1_EDX_MSR (1 << 5)
+#define CPUID_1_EDX_APIC (1 << 9)
+#define CPUID_1_EDX_PAT (1 << 16)
+
+/* Extended leaves */
+#define CPUID_EXT_MAX 0x80000000
+#define CPUID_EXT_POWER 0x80000007
+#define CPUID_EXT_POWER_EDX_INVARIANT_TSC (1 << 8)
+
+/* Model specific registers */
+#define MSR_APIC_BASE 0x1b
+#define MSR_PAT 0x277
+
+#define APIC_BASE_ENABLE (1 << 11)
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx,
+        uint32_t *ecx, uint32_t *edx)
+{
+    asm volatile ("cpuid"
+        : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+        : "a"(leaf), "c"(0));
+}
+
+static inline uint64_t rdmsr(uint32_t msr)
+{
+    uint64_t ret;
+    asm volatile ("rdmsr" : "=A"(ret) : "c"(msr));
+    return ret;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t val)
+{
+    asm volatile ("wrmsr" :: "c"(msr), "A"(val) : "memory");
+}
+
+/*
+ * Reads the time stamp counter. Not serializing, so it may be reordered with
+ * surrounding instructions, which is fine for anything longer than a few dozen
+ * cycles.
+ */
+static inline uint64_t rdtsc(void)
+{
+    uint64_t ret;
+    asm volatile ("rdtsc" : "=A"(ret));
+    return ret;
+}
+
+#endif
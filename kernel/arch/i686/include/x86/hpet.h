@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef HPET_H
+#define HPET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Starts the HPET main counter (if ACPI lists an HPET) and registers it as a
+ * clocksource. Returns whether there is one.
+ */
+bool hpet_init(void);
+
+/* Main counter value. Only valid after `hpet_init()` succeeded. */
+uint64_t hpet_read(void);
+
+/* Main counter frequency in Hz, or 0 if there is no HPET. */
+uint64_t hpet_freq(void);
+
+#endif
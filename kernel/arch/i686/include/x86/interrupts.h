@@ -44,6 +44,9 @@ enum isr_type {
 };
 
 void setup_interrupts(void);
+
+/* Defined in interrupts.s */
+void load_idt(void);
 void set_isr(uint8_t int_no, isr_stub *stub);
 void set_isr_type(uint8_t int_no, isr_stub *stub, enum isr_type type);
 
@@ -52,4 +55,7 @@ void pic_clear_mask(uint8_t irq);
 
 void pic_eoi(uint8_t irq);
 
+/* Masks all 8259 lines for good (when switching to the APIC). */
+void pic_disable(void);
+
 #endif
@@ -55,6 +55,12 @@ enum page_flags {
     /* Only on PTE. */
     PG_PAT = 128,
 
+    /* Only on PTE. Selects PAT entry 6, which `mem_init()` programs to
+     * write-combining. Without PAT support, the CPU ignores the PAT bit and
+     * the page is simply uncached. Meant for framebuffers: writes are buffered
+     * and burst out, but reads are slow. */
+    PG_WC = PG_PAT | PG_NCACHE,
+
     /* Only on PDE. Completely unsupported by the allocator right now!! */
     PG_HUGE = 128,
     PG_HUGE_PAT = 4096,
@@ -74,9 +80,14 @@ enum page_flags {
  */
 void mem_init_regions(uint32_t lower, uint32_t upper);
 
+/* Reserves physical memory. Pages already handed out to a CPU's page cache
+ * aren't taken back, so reserve before the first allocation. */
 void mem_set_used(uint64_t phys, uint64_t min_size);
 void mem_init(void);
 
+/* Per-CPU setup for the CPUs started after the boot CPU */
+void mem_init_ap(void);
+
 /*
  * Maps a physical memory region starting at `phys_start` and `n` pages long at
  * the next sufficiently sized free address range, searching from `virt_min`.
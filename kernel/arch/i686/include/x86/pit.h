@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef PIT_H
+#define PIT_H
+
+#include <stdint.h>
+
+/* Input clock of the 8253/8254 programmable interval timer, in Hz. */
+#define PIT_FREQ 1193182
+
+/*
+ * Starts channel 0 as the periodic timer interrupt (IRQ0), `HZ` times per
+ * second. Every tick advances `jiffies`.
+ */
+void pit_init(void);
+
+/*
+ * Busy-waits `us` microseconds (at most about 54ms) on channel 2, without
+ * interrupts. Meant for calibrating other clocks.
+ */
+void pit_wait_us(uint32_t us);
+
+#endif
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/x86/smp.h
+ *
+ * Starting the other CPUs. They begin in real mode at a page below 1 MiB, so
+ * a small trampoline is copied there, which switches to protected mode and
+ * paging and jumps into the kernel.
+ * see also: kernel/arch/i686/include/percpu.h
+ */
+#ifndef SMP_H
+#define SMP_H
+
+/* Where the trampoline goes, keep in sync with trampoline.s. Identity mapped
+ * (the whole first 4 MiB still are), so paging can be enabled from there. */
+#define SMP_TRAMPOLINE_PHYS 0x8000
+
+/* Wakes a CPU's worker, see `smp_send_wake()` */
+#define IPI_WAKE_VECTOR 0xf0
+/* Takes a profiling sample, see `smp_send_profile()` */
+#define IPI_PROFILE_VECTOR 0xf1
+
+/*
+ * Sets up the boot CPU's GDT, TSS and per-CPU segment. Call first thing, the
+ * allocators already use per-CPU data.
+ */
+void smp_init_boot_cpu(void);
+
+/*
+ * Starts the other CPUs listed in the MADT. Call after `apic_init()`. Without
+ * APICs, there is nothing to do.
+ */
+void smp_init(void);
+
+#endif
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef TSC_H
+#define TSC_H
+
+/*
+ * Measures the time stamp counter frequency against the HPET (or PIT channel 2
+ * without one) and registers the TSC as a clocksource.
+ */
+void tsc_init(void);
+
+#endif
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/include/x86/vconsole.h
+ *
+ * Display backends for the virtual console. The console itself
+ * (kernel/arch/i686/drivers/tty.c) always works on a buffer of VGA text mode
+ * style cells (`attribute << 8 | character`), a backend makes them visible.
+ * For VGA text mode the cell buffer *is* video memory, so there is nothing
+ * left to do. The framebuffer console (kernel/arch/i686/drivers/fbcon.c) keeps
+ * the cells in RAM and renders them.
+ *
+ * Every virtual console has its own cell buffer, but only the one in the
+ * foreground is passed to the backend.
+ */
+#ifndef VCONSOLE_H
+#define VCONSOLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vendor/grub/multiboot2.h>
+
+struct vconsole_ops {
+    /* Render cells `start`..`end` (exclusive) of the cell buffer. */
+    void (*draw)(const uint16_t *cells, size_t start, size_t end);
+
+    /* Move the displayed contents up by `lines` lines and blank the lines
+     * uncovered at the bottom. The cell buffer has already been scrolled. */
+    void (*scroll)(size_t lines);
+
+    /* Make everything drawn so far visible and put the cursor at `pos`. */
+    void (*flush)(size_t pos);
+
+    /* Display `cells` from now on (after switching consoles). */
+    void (*show)(const uint16_t *cells);
+};
+
+/*
+ * Switches the virtual consoles to a different display backend. `cells` holds
+ * `NUM_VCONSOLES` cell buffers of `cols`x`rows` cells each, `stride` cells
+ * apart. Current contents are carried over (cut off if the new buffers are
+ * smaller) and redrawn.
+ */
+void vconsole_set_backend(const struct vconsole_ops *ops, uint16_t *cells,
+        size_t stride, size_t cols, size_t rows);
+
+/*
+ * Sets up the framebuffer console from the information GRUB passed us and
+ * makes it the virtual console backend. Only direct color framebuffers with 32
+ * bits per pixel are supported. Returns whether the framebuffer console is now
+ * in use.
+ */
+bool fbcon_init(struct multiboot_tag_framebuffer *tag);
+
+#endif
@@ -1,11 +1,14 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include <x86/interrupts.h>
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include <string.h>
 #include <stdio.h>
 
+#include <irq.h>
+#include <x86/apic.h>
 #include <x86/pio.h>
 
 #include "panic.h"
@@ -19,10 +22,13 @@
 #define PIC_CASC 0x01
 #define PIC_8086 0x01
 #define PIC_EOI 0x20
+#define PIC_READ_ISR 0x0b
 
 /* defined in interrupts.s */
 extern void load_enable_interrupts(void);
 extern isr_stub *exc_isrs[32];
+extern isr_stub *irq_isrs[NR_IRQS];
+extern isr_stub int_apic_spurious;
 
 struct idt_entry {
     uint16_t offset_low;
@@ -94,6 +100,55 @@ static void init_table()
     IDTR.base = &IDT[0];
 }
 
+static void pic_mask(unsigned irq)
+{
+    pic_set_mask(irq);
+}
+
+static void pic_unmask(unsigned irq)
+{
+    pic_clear_mask(irq);
+}
+
+static void pic_irq_eoi(unsigned irq)
+{
+    pic_eoi(irq);
+}
+
+/* Lines in service, the ones being handled */
+static uint8_t pic_read_isr(uint16_t cmd)
+{
+    outb(cmd, PIC_READ_ISR);
+    return inb(cmd);
+}
+
+/*
+ * A request that goes away before the CPU takes it still raises the PIC's
+ * lowest priority line, 7 or 15, but doesn't put it in service, so it must not
+ * get an EOI. On 15 the master did take the cascade line and still needs one.
+ */
+static bool pic_spurious(unsigned irq)
+{
+    if (irq == 7)
+        return !(pic_read_isr(MS_CMD) & 0x80);
+
+    if (irq == 15 && !(pic_read_isr(SL_CMD) & 0x80)) {
+        outb(MS_CMD, PIC_EOI);
+        return true;
+    }
+    return false;
+}
+
+static const struct irq_chip pic_chip = {
+    .name = "8259",
+    .nr_irqs = 16,
+    .vector_base = IRQ_OFFSET,
+    .mask = pic_mask,
+    .unmask = pic_unmask,
+    .eoi = pic_irq_eoi,
+    .spurious = pic_spurious,
+};
+
 void setup_interrupts()
 {
     init_pic();
@@ -102,6 +157,15 @@ void setup_interrupts()
     for (int i = 0; i < 32; i++)
         set_isr_type(i, exc_isrs[i], TRAP);
 
+    for (int i = 0; i < NR_IRQS; i++)
+        set_isr(IRQ_OFFSET + i, irq_isrs[i]);
+    set_isr(APIC_SPURIOUS_VECTOR, int_apic_spurious);
+
+    /* Fall back to the 8259s only without an APIC. */
+    if (!apic_init())
+        irq_set_chip(&pic_chip);
+    printf("info: irq: using %s\n", irq_chip_name());
+
     load_enable_interrupts();
 }
 
@@ -125,7 +189,7 @@ void pic_set_mask(uint8_t irq)
     uint16_t port;
     uint8_t value;
     
-    if (irq > 8) {
+    if (irq >= 8) {
         port = SL_DATA;
         irq -= 8;
     } else {
@@ -143,7 +207,7 @@ void pic_clear_mask(uint8_t irq)
     uint16_t port;
     uint8_t value;
 
-    if (irq > 8) {
+    if (irq >= 8) {
         port = SL_DATA;
         irq -= 8;
     } else {
@@ -164,6 +228,13 @@ void pic_eoi(uint8_t irq)
     outb(MS_CMD, PIC_EOI);
 }
 
+void pic_disable()
+{
+    outb(MS_DATA, 0xff);
+    outb(SL_DATA, 0xff);
+    io_wait();
+}
+
 static const char *exceptions[32] = {
     "Division Error (#DE)",
     "Debug (#DB)",
@@ -209,9 +280,9 @@ void exception_code(uint32_t error, struct error_registers regs)
         "%%ecx = %08x\t%%edx = %08x\n"
         "%%ebp = %08x\t%%esp = %08x\n"
         "%%esi = %08x\t%%edi = %08x\n"
-        "%%eflags = %08x\n",
+        "%%eip = %08x\t%%eflags = %08x\n",
         name, regs.error_code, regs.eax, regs.ebx, regs.ecx, regs.edx,
-        regs.ebp, regs.esp, regs.esi, regs.edi, regs.eflags);
+        regs.ebp, regs.esp, regs.esi, regs.edi, regs.eip, regs.eflags);
 }
 
 void exception_no_code(uint32_t error, struct registers regs)
@@ -223,7 +294,7 @@ void exception_no_code(uint32_t error, struct registers regs)
         "%%ecx = %08x\t%%edx = %08x\n"
         "%%ebp = %08x\t%%esp = %08x\n"
         "%%esi = %08x\t%%edi = %08x\n"
-        "%%eflags = %08x\n",
+        "%%eip = %08x\t%%eflags = %08x\n",
         name, regs.eax, regs.ebx, regs.ecx, regs.edx, regs.ebp, regs.esp,
-        regs.esi, regs.edi, regs.eflags);
+        regs.esi, regs.edi, regs.eip, regs.eflags);
 }
@@ -10,6 +10,15 @@ load_enable_interrupts:
     sti
     ret
 
+    .global load_idt
+/*
+ * void load_idt(void);
+ * For the other CPUs, which share the boot CPU's IDT.
+ */
+load_idt:
+    lidt IDTR
+    ret
+
     .macro isr_exception_code n
 int_exception_\n:
     pushal
@@ -31,11 +40,36 @@ int_exception_\n:
     iret
     .endm
 
+    /* IRQ lines, all handled by handle_irq(). Pending softirqs run
+     * afterwards (with interrupts enabled), then we may switch threads.
+     * The gate disabled interrupts, `iret` enables them again: both are
+     * reported to the latency tracer. */
+    .macro isr_irq n
+int_irq_\n:
+    pushal
+    call trace_hardirqs_off
+    pushl %esp /* struct registers * */
+    pushl $\n
+    call handle_irq
+    add $8, %esp
+    call do_softirq
+    call sched_irq_exit
+    call trace_hardirqs_on
+    popal
+    iret
+    .endm
+
+    /* Other interrupts with a dedicated handler, which has to send its EOI
+     * itself. */
     .macro isr_stub handler
     .global int_\handler
 int_\handler:
     pushal
+    call trace_hardirqs_off
     call \handler
+    call do_softirq
+    call sched_irq_exit
+    call trace_hardirqs_on
     popal
     iret
     .endm
@@ -73,7 +107,66 @@ int_\handler:
     isr_exception_code 30
     isr_exception_no_code 31
 
-    isr_stub ps2_key_pressed
+    isr_irq 0
+    isr_irq 1
+    isr_irq 2
+    isr_irq 3
+    isr_irq 4
+    isr_irq 5
+    isr_irq 6
+    isr_irq 7
+    isr_irq 8
+    isr_irq 9
+    isr_irq 10
+    isr_irq 11
+    isr_irq 12
+    isr_irq 13
+    isr_irq 14
+    isr_irq 15
+    isr_irq 16
+    isr_irq 17
+    isr_irq 18
+    isr_irq 19
+    isr_irq 20
+    isr_irq 21
+    isr_irq 22
+    isr_irq 23
+    isr_irq 24
+    isr_irq 25
+    isr_irq 26
+    isr_irq 27
+    isr_irq 28
+    isr_irq 29
+    isr_irq 30
+    isr_irq 31
+
+    /* Local APIC spurious interrupt, must not be acknowledged. */
+    .global int_apic_spurious
+int_apic_spurious:
+    iret
+
+    /* Wakeup IPI. It can arrive on any CPU, so unlike the IRQ stubs it
+     * doesn't run softirqs or switch threads, which only the boot CPU does. */
+    .global int_ipi_wake
+int_ipi_wake:
+    pushal
+    call trace_hardirqs_off
+    call ipi_wake
+    call trace_hardirqs_on
+    popal
+    iret
+
+    /* Profiling IPI, records where it interrupted this CPU. */
+    .global int_ipi_profile
+int_ipi_profile:
+    pushal
+    call trace_hardirqs_off
+    pushl %esp /* struct registers * */
+    call ipi_profile
+    add $4, %esp
+    call trace_hardirqs_on
+    popal
+    iret
 
     .section .data
     .global exc_isrs
@@ -88,3 +181,15 @@ exc_isrs:
     tableent %i
     .set i, i + 1
     .endr
+
+    .global irq_isrs
+irq_isrs:
+    .macro irqent i
+    .long int_irq_\i
+    .endm
+
+    .set i, 0
+    .rept 32
+    irqent %i
+    .set i, i + 1
+    .endr
@@ -13,6 +13,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <percpu.h>
+#include <spinlock.h>
+#include <x86/cpu.h>
+
 /* The portion of physical memory that is guaranteed to be usable */
 /* TODO: Get rid of this. Are systems even required to have high memory? */
 #define PROT_PHYS_START 0x00100000
@@ -22,11 +26,35 @@
 
 #define PAGE_TABLE_SIZE 1024
 
+/* Pages a CPU takes from the bitmap at once */
+#define PAGE_MAGAZINE_BATCH 16
+
+/* Memory types for the page attribute table */
+#define PAT_WC 0x01
+#define PAT_MASK(entry) ((uint64_t)0xff << ((entry) * 8))
+#define PAT_ENTRY(entry, type) ((uint64_t)(type) << ((entry) * 8))
+
 /* defined in linker.ld */
 extern char __kernel_virtual_offset, __kernel_start, __kernel_end;
 
 static uint32_t lower_bound = PROT_PHYS_START, upper_bound = PROT_PHYS_END;
 
+/* Protects the page tables */
+static struct spinlock mem_lock = SPINLOCK_INIT("mem");
+
+/* Protects the physical page bitmap, taken inside `mem_lock` */
+static struct spinlock phys_lock = SPINLOCK_INIT("phys");
+
+/* Every CPU keeps a few free physical pages of its own, so allocating a page
+ * is usually a pop with interrupts disabled. An empty magazine is refilled in
+ * one batch from the bitmap. */
+struct page_magazine {
+    size_t n;
+    uint32_t pages[PAGE_MAGAZINE_BATCH];
+} __attribute__((aligned(64)));
+
+static struct page_magazine page_magazines[NR_CPUS];
+
 /* By mapping the last PDE to the page directory itself, we can access all
  * paging structures (in the current address space) starting at 0xffc00000,
  * through the CPU interpreting the page directory as a page table and
@@ -81,17 +109,39 @@ static bool is_virt_region_used(size_t *start_page, size_t n)
     return false;
 }
 
-static uint32_t alloc_phys()
+/* Takes up to `n` free pages off the bitmap in one scan. */
+static size_t take_phys(uint32_t *pages, size_t n)
 {
-    uint32_t ret;
-    for (ret = lower_bound; ret < upper_bound; ret += PAGE_SIZE) {
-        if (!is_phys_used(ret)) {
-            set_phys_used(ret, true);
-            return ret;
+    irqflags_t flags = spin_lock_irqsave(&phys_lock);
+
+    size_t got = 0;
+    for (uint32_t phys = lower_bound; phys < upper_bound && got < n;
+            phys += PAGE_SIZE) {
+        if (!is_phys_used(phys)) {
+            set_phys_used(phys, true);
+            pages[got++] = phys;
         }
     }
-    printf("err: mem: out of memory (phys)\n");
-    return -1;
+
+    spin_unlock_irqrestore(&phys_lock, flags);
+    return got;
+}
+
+static uint32_t alloc_phys()
+{
+    irqflags_t flags = local_irq_save();
+
+    struct page_magazine *mag = &page_magazines[smp_processor_id()];
+    if (!mag->n)
+        mag->n = take_phys(mag->pages, PAGE_MAGAZINE_BATCH);
+
+    uint32_t ret = mag->n ? mag->pages[--mag->n] : (uint32_t)-1;
+
+    local_irq_restore(flags);
+
+    if (ret == (uint32_t)-1)
+        printf("err: mem: out of memory (phys)\n");
+    return ret;
 }
 
 void mem_init_regions(uint32_t lower, uint32_t upper)
@@ -119,15 +169,36 @@ void mem_set_used(uint64_t phys, uint64_t min_size)
     uint64_t max = phys + min_size;
     max = (max > UINT32_MAX) ? UINT32_MAX : max;
     
+    irqflags_t flags = spin_lock_irqsave(&phys_lock);
+
     uint32_t page = phys & ~4095;
     do {
         set_phys_used(page, true);
         page += PAGE_SIZE;
     } while (page < max && page != 0);
+
+    spin_unlock_irqrestore(&phys_lock, flags);
+}
+
+static void init_pat()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_1_EDX_PAT))
+        return;
+
+    /* Entry 6 (PAT | PCD) defaults to UC-. Make it write-combining, leaving
+     * the entries reachable without the PAT bit at their power-on defaults. */
+    uint64_t pat = rdmsr(MSR_PAT);
+    pat &= ~PAT_MASK(6);
+    pat |= PAT_ENTRY(6, PAT_WC);
+    wrmsr(MSR_PAT, pat);
 }
 
 void mem_init()
 {
+    init_pat();
+
     for (uint32_t phys = (uint32_t)&__kernel_start & ~4095;
             phys < (uint32_t)&__kernel_end;
             phys += PAGE_SIZE) {
@@ -135,7 +206,14 @@ void mem_init()
     }
 }
 
-void *mem_map(uint32_t virt_min, size_t n, uint32_t phys,
+void mem_init_ap()
+{
+    /* All CPUs need the same memory types. */
+    init_pat();
+}
+
+/* Called holding mem_lock */
+static void *do_map(uint32_t virt_min, size_t n, uint32_t phys,
         enum page_flags flags)
 {
     if (phys % PAGE_SIZE != 0) {
@@ -168,6 +246,15 @@ void *mem_map(uint32_t virt_min, size_t n, uint32_t phys,
     return (void *)((uint32_t)page_start * PAGE_SIZE);
 }
 
+void *mem_map(uint32_t virt_min, size_t n, uint32_t phys,
+        enum page_flags flags)
+{
+    irqflags_t irqflags = spin_lock_irqsave(&mem_lock);
+    void *virt = do_map(virt_min, n, phys, flags);
+    spin_unlock_irqrestore(&mem_lock, irqflags);
+    return virt;
+}
+
 void *mem_map_range(uint32_t virt_min, uint32_t phys_start, uint32_t phys_end,
         enum page_flags flags)
 {
@@ -177,11 +264,12 @@ void *mem_map_range(uint32_t virt_min, uint32_t phys_start, uint32_t phys_end,
     }
 
     size_t page_offset = phys_start & 4095;
-    size_t n = (phys_end - phys_start + 4095) / PAGE_SIZE;
+    size_t n = (page_offset + phys_end - phys_start + 4095) / PAGE_SIZE;
 
     phys_start &= ~4095;
 
-    return mem_map(virt_min, n, phys_start, flags) + page_offset;
+    void *virt = mem_map(virt_min, n, phys_start, flags);
+    return virt ? virt + page_offset : NULL;
 }
 
 void *mem_alloc(uint32_t virt, uint32_t virt_end_max, size_t n,
@@ -192,13 +280,18 @@ void *mem_alloc(uint32_t virt, uint32_t virt_end_max, size_t n,
 
     if (page_start + n > page_max)
         return NULL;
-    
-    if (is_virt_region_used(&page_start, n))
+
+    irqflags_t irqflags = spin_lock_irqsave(&mem_lock);
+
+    if (is_virt_region_used(&page_start, n)) {
+        spin_unlock_irqrestore(&mem_lock, irqflags);
         return NULL;
+    }
 
     /* No used page within reach - we've found space! */
     for (size_t page = page_start; page < page_start + n; page++)
-        mem_map(page * PAGE_SIZE, 1, alloc_phys(), flags);
+        do_map(page * PAGE_SIZE, 1, alloc_phys(), flags);
 
+    spin_unlock_irqrestore(&mem_lock, irqflags);
     return (void *)virt;
 }
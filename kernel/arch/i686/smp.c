@@ -0,0 +1,255 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/smp.c
+ *
+ * CPU startup and per-CPU segments. The boot CPU starts the others one at a
+ * time with INIT-SIPI-SIPI and waits for each to report in. The others don't
+ * run threads (the scheduler is still single CPU), they run queued work and
+ * halt when there is none.
+ * see also: kernel/arch/i686/include/x86/smp.h
+ */
+
+#include <x86/smp.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <barrier.h>
+#include <irqflags.h>
+#include <percpu.h>
+#include <x86/apic.h>
+#include <x86/interrupts.h>
+#include <x86/mem.h>
+#include <x86/pit.h>
+#include <profile.h>
+#include <rcu.h>
+#include <workqueue.h>
+
+/* Segment descriptor access bytes */
+#define SEG_PRESENT (1 << 7)
+#define SEG_RING3 (3 << 5)
+#define SEG_NSYSTEM (1 << 4)
+#define SEG_CODE (0xa) /* execute/read */
+#define SEG_DATA (0x2) /* read/write */
+#define SEG_TSS (0x9) /* 32-bit TSS, available */
+
+/* Descriptor flags */
+#define SEG_GRAN_4K (1 << 3)
+#define SEG_32BIT (1 << 2)
+
+/* How long a CPU gets to report in */
+#define AP_START_TIMEOUT_MS 100
+
+/* defined in trampoline.s */
+extern char trampoline_start[], trampoline_end[];
+extern char trampoline_cr3[], trampoline_stack[], trampoline_entry[];
+
+/* defined in boot0.s */
+extern char stack_top[];
+
+/* defined in interrupts.s */
+extern isr_stub int_ipi_wake, int_ipi_profile;
+
+struct cpu cpus[NR_CPUS];
+
+static unsigned num_online = 1;
+
+/* The CPU being started, for `ap_main()` */
+static struct cpu *volatile booting_cpu;
+
+static uint64_t gdt_entry(uint32_t base, uint32_t limit, uint8_t access,
+        uint8_t flags)
+{
+    return (uint64_t)(limit & 0xffff) |
+        (uint64_t)(base & 0xffffff) << 16 |
+        (uint64_t)access << 40 |
+        (uint64_t)((limit >> 16) & 0xf) << 48 |
+        (uint64_t)(flags & 0xf) << 52 |
+        (uint64_t)(base >> 24) << 56;
+}
+
+/* Builds and loads the calling CPU's GDT, TSS and per-CPU segment. */
+static void cpu_setup(struct cpu *cpu)
+{
+    cpu->self = cpu;
+
+    memset(&cpu->tss, 0, sizeof(cpu->tss));
+    cpu->tss.ss0 = GDT_K_DATA;
+    cpu->tss.esp0 = (uint32_t)cpu->stack_top;
+    cpu->tss.iomap_base = sizeof(cpu->tss); /* no I/O permission bitmap */
+
+    uint8_t flat = SEG_GRAN_4K | SEG_32BIT;
+    cpu->gdt[0] = 0;
+    cpu->gdt[GDT_K_CODE / 8] = gdt_entry(0, 0xfffff,
+        SEG_PRESENT | SEG_NSYSTEM | SEG_CODE, flat);
+    cpu->gdt[GDT_K_DATA / 8] = gdt_entry(0, 0xfffff,
+        SEG_PRESENT | SEG_NSYSTEM | SEG_DATA, flat);
+    cpu->gdt[GDT_U_CODE / 8] = gdt_entry(0, 0xfffff,
+        SEG_PRESENT | SEG_NSYSTEM | SEG_RING3 | SEG_CODE, flat);
+    cpu->gdt[GDT_U_DATA / 8] = gdt_entry(0, 0xfffff,
+        SEG_PRESENT | SEG_NSYSTEM | SEG_RING3 | SEG_DATA, flat);
+    cpu->gdt[GDT_TSS / 8] = gdt_entry((uint32_t)&cpu->tss,
+        sizeof(cpu->tss) - 1, SEG_PRESENT | SEG_TSS, 0);
+    cpu->gdt[GDT_PERCPU / 8] = gdt_entry((uint32_t)cpu, sizeof(*cpu) - 1,
+        SEG_PRESENT | SEG_NSYSTEM | SEG_DATA, SEG_32BIT);
+
+    struct {
+        uint16_t size;
+        uint32_t base;
+    } __attribute__((packed)) gdt_ptr = {
+        .size = sizeof(cpu->gdt) - 1,
+        .base = (uint32_t)cpu->gdt,
+    };
+
+    asm volatile (
+        "lgdt %0\n\t"
+        "ljmp %1, $1f\n"
+        "1:\n\t"
+        "movw %w2, %%ds\n\t"
+        "movw %w2, %%es\n\t"
+        "movw %w2, %%fs\n\t"
+        "movw %w2, %%ss\n\t"
+        "movw %w3, %%gs\n\t"
+        "ltr %w4"
+        :: "m"(gdt_ptr), "i"(GDT_K_CODE), "r"(GDT_K_DATA), "r"(GDT_PERCPU),
+           "r"(GDT_TSS)
+        : "memory");
+}
+
+static void ap_main()
+{
+    struct cpu *cpu = booting_cpu;
+
+    cpu_setup(cpu);
+    load_idt();
+    mem_init_ap();
+    lapic_ap_init();
+
+    smp_wmb();
+    cpu->online = true;
+
+    work_cpu_loop();
+}
+
+static bool start_cpu(struct cpu *cpu)
+{
+    cpu->stack_top = malloc(CPU_STACK_SIZE);
+    if (!cpu->stack_top)
+        return false;
+    cpu->stack_top += CPU_STACK_SIZE;
+
+    void *tramp = (void *)SMP_TRAMPOLINE_PHYS;
+    *(uint32_t *)(tramp + (trampoline_stack - trampoline_start)) =
+        (uint32_t)cpu->stack_top;
+
+    booting_cpu = cpu;
+    smp_wmb();
+
+    lapic_send_init(cpu->apic_id);
+    pit_wait_us(10000);
+
+    for (int i = 0; i < 2 && !cpu->online; i++) {
+        lapic_send_startup(cpu->apic_id, SMP_TRAMPOLINE_PHYS);
+        pit_wait_us(200);
+    }
+
+    for (int ms = 0; ms < AP_START_TIMEOUT_MS && !cpu->online; ms++)
+        pit_wait_us(1000);
+
+    if (cpu->online)
+        return true;
+
+    /* It may just be slow. Put it back into INIT, where it waits for a
+     * startup IPI that never comes, so it can't turn up later on the `cpus`
+     * slot and trampoline stack the next CPU gets. */
+    lapic_send_init(cpu->apic_id);
+    pit_wait_us(10000);
+
+    cpu->online = false;
+    free(cpu->stack_top - CPU_STACK_SIZE);
+    return false;
+}
+
+void smp_init_boot_cpu()
+{
+    struct cpu *bsp = &cpus[0];
+
+    bsp->id = 0;
+    bsp->stack_top = stack_top;
+    bsp->online = true;
+    cpu_setup(bsp);
+}
+
+void smp_init()
+{
+    struct cpu *bsp = &cpus[0];
+
+    bsp->apic_id = lapic_id();
+
+    set_isr(IPI_WAKE_VECTOR, int_ipi_wake);
+    set_isr(IPI_PROFILE_VECTOR, int_ipi_profile);
+
+    if (apic_num_cpus() <= 1)
+        return;
+
+    /* Lower memory is still identity mapped, so the trampoline can be
+     * written (and run) at its physical address. */
+    void *tramp = (void *)SMP_TRAMPOLINE_PHYS;
+    memcpy(tramp, trampoline_start, trampoline_end - trampoline_start);
+
+    uint32_t cr3;
+    asm volatile ("movl %%cr3, %0" : "=r"(cr3));
+    *(uint32_t *)(tramp + (trampoline_cr3 - trampoline_start)) = cr3;
+    *(uint32_t *)(tramp + (trampoline_entry - trampoline_start)) =
+        (uint32_t)ap_main;
+
+    for (unsigned i = 0; i < apic_num_cpus() && num_online < NR_CPUS; i++) {
+        uint8_t apic_id = apic_cpu_id(i);
+        if (apic_id == bsp->apic_id)
+            continue;
+
+        struct cpu *cpu = &cpus[num_online];
+        cpu->id = num_online;
+        cpu->apic_id = apic_id;
+
+        if (start_cpu(cpu))
+            num_online++;
+        else
+            printf("warn: smp: CPU with APIC ID %d did not start\n", apic_id);
+    }
+
+    printf("info: smp: %u CPU(s) online\n", num_online);
+}
+
+void ipi_wake()
+{
+    lapic_eoi();
+    work_kick();
+    rcu_kick();
+}
+
+void smp_send_wake(unsigned cpu)
+{
+    lapic_send_ipi(cpus[cpu].apic_id, IPI_WAKE_VECTOR);
+}
+
+void ipi_profile(struct registers *regs)
+{
+    lapic_eoi();
+    profile_sample(regs);
+}
+
+void smp_send_profile(unsigned cpu)
+{
+    lapic_send_ipi(cpus[cpu].apic_id, IPI_PROFILE_VECTOR);
+}
+
+unsigned num_online_cpus()
+{
+    return num_online;
+}
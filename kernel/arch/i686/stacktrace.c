@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/stacktrace.c
+ *
+ * Frame pointer unwinding. This also runs on interrupted code, where %ebp
+ * may not point to a frame (yet), so frames are sanity checked before they
+ * are followed: they have to be in the kernel half, and every caller's frame
+ * a little further up the same stack.
+ * see also: kernel/arch/i686/include/stacktrace.h
+ */
+
+#include <stacktrace.h>
+
+#include <stdint.h>
+
+#include <x86/interrupts.h>
+#include <x86/mem.h>
+
+/* Stacks are smaller than this, so callers' frames are never further away. */
+#define MAX_FRAME_SIZE 16384
+
+static unsigned walk(const struct stack_frame *fp, void **entries,
+        unsigned n, unsigned max)
+{
+    while (n < max) {
+        if ((uint32_t)fp < K_MEM_START || (uint32_t)fp % 4 != 0 || !fp->ret)
+            break;
+
+        entries[n++] = fp->ret;
+
+        const struct stack_frame *next = fp->next;
+        if (next <= fp || (uint32_t)next - (uint32_t)fp > MAX_FRAME_SIZE)
+            break;
+        fp = next;
+    }
+    return n;
+}
+
+__attribute__((noinline))
+unsigned stack_trace(void **entries, unsigned max)
+{
+    return walk(__builtin_frame_address(0), entries, 0, max);
+}
+
+unsigned stack_trace_regs(const struct registers *regs, void **entries,
+        unsigned max)
+{
+    if (!max)
+        return 0;
+
+    entries[0] = (void *)regs->eip;
+    return walk((const struct stack_frame *)regs->ebp, entries, 1, max);
+}
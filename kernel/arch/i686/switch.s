@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+    .section .text
+    .global switch_stack
+
+/*
+ * void switch_stack(void **old_sp, void *new_sp);
+ * Only the callee-saved registers need saving, the caller saved the rest.
+ * Keep the layout in sync with stack_init() in switch.h.
+ */
+switch_stack:
+    movl 4(%esp), %eax
+    movl 8(%esp), %edx
+
+    pushl %ebp
+    pushl %ebx
+    pushl %esi
+    pushl %edi
+
+    movl %esp, (%eax)
+    movl %edx, %esp
+
+    popl %edi
+    popl %esi
+    popl %ebx
+    popl %ebp
+    ret
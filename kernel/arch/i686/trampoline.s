@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * Startup code for the CPUs started after the boot CPU, copied to
+ * SMP_TRAMPOLINE_PHYS (see x86/smp.h) by smp_init(). A CPU wakes up from the
+ * startup IPI in real mode at the start of that page, with everything
+ * addressed relative to where the code ends up, not where it's linked.
+ */
+    .set TRAMPOLINE, 0x8000
+    .set k_code, 0x08
+    .set k_data, 0x10
+
+    .set CR0_PE, 1 << 0
+    .set CR0_PG, 1 << 31
+
+    .section .rodata
+    .global trampoline_start, trampoline_end
+    .global trampoline_cr3, trampoline_stack, trampoline_entry
+
+    .code16
+trampoline_start:
+    cli
+    cld
+    xorw %ax, %ax
+    movw %ax, %ds
+
+    lgdtl TRAMPOLINE + (tramp_gdt_ptr - trampoline_start)
+
+    movl %cr0, %eax
+    orl $CR0_PE, %eax
+    movl %eax, %cr0
+
+    ljmpl $k_code, $(TRAMPOLINE + (tramp_32 - trampoline_start))
+
+    .code32
+tramp_32:
+    movw $k_data, %ax
+    movw %ax, %ds
+    movw %ax, %es
+    movw %ax, %fs
+    movw %ax, %gs
+    movw %ax, %ss
+
+    /* The boot CPU's page directory. */
+    movl TRAMPOLINE + (trampoline_cr3 - trampoline_start), %eax
+    movl %eax, %cr3
+
+    movl %cr0, %eax
+    orl $CR0_PG, %eax
+    movl %eax, %cr0
+
+    movl TRAMPOLINE + (trampoline_stack - trampoline_start), %esp
+    xorl %ebp, %ebp
+
+    /* Into the higher half, never returns. */
+    movl TRAMPOLINE + (trampoline_entry - trampoline_start), %eax
+    call *%eax
+
+1:
+    hlt
+    jmp 1b
+
+    /* Flat code and data segments, same selectors as the kernel's GDT. */
+    .align 8
+tramp_gdt:
+    .long 0, 0
+    .word 0xffff, 0x0000
+    .byte 0x00, 0x9a, 0xcf, 0x00
+    .word 0xffff, 0x0000
+    .byte 0x00, 0x92, 0xcf, 0x00
+
+tramp_gdt_ptr:
+    .word tramp_gdt_ptr - tramp_gdt - 1
+    .long TRAMPOLINE + (tramp_gdt - trampoline_start)
+
+    /* Filled in by smp_init() for every CPU it starts. */
+    .align 4
+trampoline_cr3:
+    .long 0
+trampoline_stack:
+    .long 0
+trampoline_entry:
+    .long 0
+trampoline_end:
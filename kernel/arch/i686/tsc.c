@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/arch/i686/tsc.c
+ *
+ * Time stamp counter calibration. The TSC is the cheapest clock there is (one
+ * instruction, no I/O), but its frequency has to be measured against a timer
+ * of known frequency first.
+ */
+
+#include <x86/tsc.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <irqflags.h>
+#include <ktime.h>
+#include <x86/cpu.h>
+#include <x86/hpet.h>
+#include <x86/pit.h>
+
+#define CALIBRATE_US 10000
+#define CALIBRATE_RUNS 3
+
+static struct clocksource tsc_clocksource = {
+    .name = "tsc",
+    .rating = 300,
+    .read = NULL, /* inline get_cycles() */
+};
+
+/* TSC ticks per second, measured against the PIT. */
+static uint64_t calibrate_pit()
+{
+    irqflags_t flags = local_irq_save();
+
+    uint64_t start = rdtsc();
+    pit_wait_us(CALIBRATE_US);
+    uint64_t ticks = rdtsc() - start;
+
+    local_irq_restore(flags);
+
+    return ticks * (1000000 / CALIBRATE_US);
+}
+
+/* TSC ticks per second, measured against the HPET. */
+static uint64_t calibrate_hpet()
+{
+    uint64_t hpet_ticks = hpet_freq() / (1000000 / CALIBRATE_US);
+
+    irqflags_t flags = local_irq_save();
+
+    uint64_t hpet_start = hpet_read();
+    uint64_t start = rdtsc();
+    uint64_t hpet_now;
+    while ((hpet_now = hpet_read()) - hpet_start < hpet_ticks)
+        ;
+    uint64_t ticks = rdtsc() - start;
+
+    local_irq_restore(flags);
+
+    return ticks * hpet_freq() / (hpet_now - hpet_start);
+}
+
+void tsc_init()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_1_EDX_TSC)) {
+        printf("warn: tsc: no time stamp counter\n");
+        return;
+    }
+
+    bool hpet = hpet_freq() != 0;
+
+    /* Anything that interrupts a run (SMIs, the host scheduling another
+     * guest) makes it longer, so the shortest run is the most accurate. */
+    uint64_t freq = UINT64_MAX;
+    for (int i = 0; i < CALIBRATE_RUNS; i++) {
+        uint64_t f = hpet ? calibrate_hpet() : calibrate_pit();
+        if (f < freq)
+            freq = f;
+    }
+
+    /* Without an invariant TSC, the frequency changes with power states, so
+     * it is a bad clocksource (though fine for counting cycles). */
+    cpuid(CPUID_EXT_MAX, &eax, &ebx, &ecx, &edx);
+    bool invariant = false;
+    if (eax >= CPUID_EXT_POWER) {
+        cpuid(CPUID_EXT_POWER, &eax, &ebx, &ecx, &edx);
+        invariant = edx & CPUID_EXT_POWER_EDX_INVARIANT_TSC;
+    }
+    if (!invariant)
+        tsc_clocksource.rating = 100;
+
+    uint32_t khz = freq / 1000;
+    printf("info: tsc: %u.%03u MHz (calibrated against %s)%s\n", khz / 1000,
+        khz % 1000, hpet ? "HPET" : "PIT", invariant ? "" : ", not invariant");
+
+    tsc_clocksource.freq = freq;
+    clocksource_register(&tsc_clocksource);
+}
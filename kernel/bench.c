@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/bench.c
+ *
+ * Benchmark runner and result reporting. Each timed batch gives one sample of
+ * cycles per iteration. Interrupts stay enabled, so the ticks and whatever
+ * else comes in show up in the upper percentiles, not in the minimum.
+ * see also: kernel/include/bench.h
+ */
+
+#include "bench.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cycles.h>
+
+/* Never more iterations per batch than this, in case `fn` does nothing. */
+#define BENCH_MAX_ITERS (1u << 24)
+
+/* From the linker script */
+extern const struct benchmark __bench_start[], __bench_end[];
+
+void bench_report(const char *name, uint64_t value, const char *unit,
+        enum bench_better better)
+{
+    printf("bench: result %s %llu %s %s\n", name, value, unit,
+        better == BENCH_HIGHER_IS_BETTER ? "higher" : "lower");
+}
+
+/* Whether `cmdline` has the word "bench=<name>" (not just a prefix of it). */
+static bool selected(const char *cmdline, const char *name)
+{
+    size_t len = strlen(name);
+
+    for (const char *p = cmdline; (p = strstr(p, "bench=")); p++) {
+        if ((p == cmdline || p[-1] == ' ') &&
+                !strncmp(p + 6, name, len) &&
+                (p[6 + len] == ' ' || !p[6 + len]))
+            return true;
+    }
+    return false;
+}
+
+static uint64_t time_batch(bench_f fn, uint32_t iters)
+{
+    uint64_t start = get_cycles();
+    fn(iters);
+    return get_cycles() - start;
+}
+
+static void report(const char *name, const char *stat, uint64_t cycles)
+{
+    char result[64];
+    snprintf(result, sizeof(result), "%s.%s", name, stat);
+    bench_report(result, cycles, "cycles", BENCH_LOWER_IS_BETTER);
+}
+
+static void run(const struct benchmark *b)
+{
+    uint64_t *samples = malloc(BENCH_SAMPLES * sizeof(*samples));
+    if (!samples) {
+        printf("err: bench: no memory to run %s\n", b->name);
+        return;
+    }
+
+    /* The first run also faults in and caches whatever it touches. */
+    uint32_t iters = 1;
+    while (time_batch(b->fn, iters) < BENCH_BATCH_CYCLES &&
+            iters < BENCH_MAX_ITERS)
+        iters *= 2;
+
+    for (int i = 0; i < BENCH_WARMUP; i++)
+        time_batch(b->fn, iters);
+
+    /* Sorted as they come in */
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        uint64_t per_iter = time_batch(b->fn, iters) / iters;
+        int j = i;
+        for (; j > 0 && samples[j - 1] > per_iter; j--)
+            samples[j] = samples[j - 1];
+        samples[j] = per_iter;
+    }
+
+    printf("info: bench: %s: %u iterations per batch\n", b->name, iters);
+    report(b->name, "min", samples[0]);
+    report(b->name, "median", samples[BENCH_SAMPLES / 2]);
+    report(b->name, "p99", samples[(BENCH_SAMPLES * 99 + 99) / 100 - 1]);
+
+    free(samples);
+}
+
+void bench_run(const char *cmdline)
+{
+    for (const struct benchmark *b = __bench_start; b < __bench_end; b++) {
+        if (!selected(cmdline, b->name))
+            continue;
+
+        if (b->run)
+            b->run();
+        else
+            run(b);
+    }
+}
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/drivers/char/procinfo.c
+ *
+ * Statistics devices. A read generates the whole report into a temporary
+ * buffer and returns the part at the requested offset, so reading a report
+ * in several pieces may mix up two different snapshots.
+ * see also: kernel/include/drivers/procinfo.h
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <initcall.h>
+#include <drivers/driver.h>
+#include <drivers/major.h>
+#include <drivers/procinfo.h>
+
+#include "types.h"
+
+/* Reports longer than this are cut off. */
+#define REPORT_SIZE 16384
+
+static procinfo_show_f shows[NUM_PROCINFO];
+
+int seq_printf(struct seqbuf *s, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+
+    size_t room = s->size - s->len;
+    int n = vsnprintf(&s->buf[s->len], room, format, args);
+
+    va_end(args);
+
+    s->len += (size_t)n < room ? (size_t)n : room - 1;
+    return n;
+}
+
+void register_procinfo(unsigned minor, procinfo_show_f show)
+{
+    if (minor >= NUM_PROCINFO || shows[minor]) {
+        printf("err: procinfo: minor number taken: %u\n", minor);
+        return;
+    }
+    shows[minor] = show;
+}
+
+int procinfo_read(dev_t dev, off_t pos, char *buf, size_t n)
+{
+    dev_t m = MINOR(dev);
+    if (m >= NUM_PROCINFO || !shows[m])
+        return -ENODEV;
+
+    struct seqbuf s = { .buf = malloc(REPORT_SIZE), .size = REPORT_SIZE };
+    if (!s.buf)
+        return -EAGAIN;
+
+    shows[m](&s);
+
+    size_t count = 0;
+    if (pos < s.len) {
+        count = s.len - pos < n ? s.len - pos : n;
+        memcpy(buf, &s.buf[pos], count);
+    }
+
+    free(s.buf);
+    return count;
+}
+
+int procinfo_write(dev_t dev, off_t pos, const char *buf, size_t n)
+{
+    (void)dev;
+    (void)pos;
+    (void)buf;
+    (void)n;
+    return -EPERM;
+}
+
+struct char_driver procinfo_driver = {
+    .read = procinfo_read,
+    .write = procinfo_write,
+};
+
+void register_procinfo_driver()
+{
+    register_char_driver(CHR_PROCINFO, &procinfo_driver);
+}
+
+core_initcall(register_procinfo_driver);
@@ -18,36 +18,58 @@
 
 /*
  * Minor device numbers:
- * 0    virtual console
+ * 0    Virtual console in the foreground
  * 1    First serial port (if present)
  * ...  ...
  * 127  127th serial port (if present)
- * 128- Reserved (possibly more virtual consoles)
+ * 128  First virtual console (system console)
+ * ...  ...
+ * 135  8th virtual console
+ * 136- Reserved
  */
 
+#define VC_MINOR 128
+
 int tty_read(dev_t dev, off_t pos, char *buf, size_t n)
 {
     dev_t m = MINOR(dev);
     if (m == 0)
-        return vconsole_read(buf, n);
-    else if (m < 128)
+        return vconsole_read(VC_FOREGROUND, buf, n);
+    else if (m < VC_MINOR)
         return serial_read(m, buf, n);
+    else if (m < VC_MINOR + NUM_VCONSOLES)
+        return vconsole_read(m - VC_MINOR, buf, n);
     return -ENODEV;
 }
 
+struct wait_queue *tty_read_queue(dev_t dev)
+{
+    dev_t m = MINOR(dev);
+    if (m == 0)
+        return vconsole_read_queue(VC_FOREGROUND);
+    else if (m < VC_MINOR)
+        return serial_read_queue(m);
+    else if (m < VC_MINOR + NUM_VCONSOLES)
+        return vconsole_read_queue(m - VC_MINOR);
+    return NULL;
+}
+
 int tty_write(dev_t dev, off_t pos, const char *buf, size_t n)
 {
     dev_t m = MINOR(dev);
     if (m == 0)
-        return vconsole_write(buf, n);
-    else if (m < 128)
+        return vconsole_write(VC_FOREGROUND, buf, n);
+    else if (m < VC_MINOR)
         return serial_write(m, buf, n);
+    else if (m < VC_MINOR + NUM_VCONSOLES)
+        return vconsole_write(m - VC_MINOR, buf, n);
     return -ENODEV;
 }
 
 struct char_driver tty_driver = {
     .read = tty_read,
     .write = tty_write,
+    .read_queue = tty_read_queue,
 };
 
 void register_tty_driver()
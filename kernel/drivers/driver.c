@@ -6,68 +6,137 @@
 
 #include <drivers/major.h>
 
+#include "rcu.h"
+#include "spinlock.h"
+#include "wait.h"
+
+/*
+ * Looked up on every access, but only changed when drivers come and go, so
+ * readers use RCU: a driver is called inside the read section it was looked up
+ * in, and unregistering waits for those to end. `drivers_lock` serializes the
+ * writers.
+ */
 static struct char_driver *char_drivers[256];
 static struct block_driver *block_drivers[256];
 
+static struct spinlock drivers_lock = SPINLOCK_INIT("drivers");
+
 void register_char_driver(unsigned char major, struct char_driver *dr)
 {
-    if (char_drivers[major]) {
+    irqflags_t flags = spin_lock_irqsave(&drivers_lock);
+    struct char_driver *old = char_drivers[major];
+    if (!old)
+        rcu_assign_pointer(char_drivers[major], dr);
+    spin_unlock_irqrestore(&drivers_lock, flags);
+
+    if (old)
         printf("err: device number taken: %d char\n"
                 "\tdriver 1: %p\n"
-                "\tdriver 2: %p\n", major, char_drivers[major], dr);
-        return;
-    }
+                "\tdriver 2: %p\n", major, old, dr);
+}
+
+void unregister_char_driver(unsigned char major)
+{
+    irqflags_t flags = spin_lock_irqsave(&drivers_lock);
+    rcu_assign_pointer(char_drivers[major], NULL);
+    spin_unlock_irqrestore(&drivers_lock, flags);
+
+    synchronize_rcu();
+}
+
+/* One read attempt, the driver can't go away in the middle of it. */
+static int try_read_char(dev_t dev, off_t pos, char *buf, size_t n)
+{
+    rcu_read_lock();
+    struct char_driver *dr = rcu_dereference(char_drivers[MAJOR(dev)]);
+    int ret = dr ? dr->read(dev, pos, buf, n) : -ENODEV;
+    rcu_read_unlock();
+    return ret;
+}
 
-    char_drivers[major] = dr;
+int read_char_timeout(dev_t dev, off_t pos, char *buf, size_t n,
+        uint32_t timeout_ms)
+{
+    /* Read queues are static, they stay around after the driver is gone. */
+    rcu_read_lock();
+    struct char_driver *dr = rcu_dereference(char_drivers[MAJOR(dev)]);
+    struct wait_queue *wq = dr && dr->read_queue ? dr->read_queue(dev) : NULL;
+    rcu_read_unlock();
+
+    if (!wq || !timeout_ms || !n)
+        return try_read_char(dev, pos, buf, n);
+
+    int ret;
+    wait_event_timeout(wq, (ret = try_read_char(dev, pos, buf, n)) != 0,
+        timeout_ms);
+    return ret;
 }
 
 int read_char(dev_t dev, off_t pos, char *buf, size_t n)
 {
-    if (!char_drivers[MAJOR(dev)])
-        return -ENODEV;
-    
-    return char_drivers[MAJOR(dev)]->read(dev, pos, buf, n);
+    return read_char_timeout(dev, pos, buf, n, WAIT_FOREVER);
+}
+
+int read_char_nonblock(dev_t dev, off_t pos, char *buf, size_t n)
+{
+    return read_char_timeout(dev, pos, buf, n, 0);
 }
 
 int write_char(dev_t dev, off_t pos, const char *buf, size_t n)
 {
-    if (!char_drivers[MAJOR(dev)])
-        return -ENODEV;
-    
-    return char_drivers[MAJOR(dev)]->write(dev, pos, buf, n);
+    rcu_read_lock();
+    struct char_driver *dr = rcu_dereference(char_drivers[MAJOR(dev)]);
+    int ret = dr ? dr->write(dev, pos, buf, n) : -ENODEV;
+    rcu_read_unlock();
+    return ret;
 }
 
 void register_block_driver(unsigned char major, struct block_driver *dr)
 {
-    if (block_drivers[major]) {
+    irqflags_t flags = spin_lock_irqsave(&drivers_lock);
+    struct block_driver *old = block_drivers[major];
+    if (!old)
+        rcu_assign_pointer(block_drivers[major], dr);
+    spin_unlock_irqrestore(&drivers_lock, flags);
+
+    if (old)
         printf("err: device number taken: %d block\n"
                 "\tdriver 1: %p\n"
-                "\tdriver 2: %p\n", major, block_drivers[major], dr);
-        return;
-    }
+                "\tdriver 2: %p\n", major, old, dr);
+}
 
-    block_drivers[major] = dr;
+void unregister_block_driver(unsigned char major)
+{
+    irqflags_t flags = spin_lock_irqsave(&drivers_lock);
+    rcu_assign_pointer(block_drivers[major], NULL);
+    spin_unlock_irqrestore(&drivers_lock, flags);
+
+    synchronize_rcu();
 }
 
 blksize_t getblksize(dev_t dev)
 {
-    if (!block_drivers[MAJOR(dev)])
-        return 0;
-    
-    return block_drivers[MAJOR(dev)]->getblksize(dev);
+    rcu_read_lock();
+    struct block_driver *dr = rcu_dereference(block_drivers[MAJOR(dev)]);
+    blksize_t ret = dr ? dr->getblksize(dev) : 0;
+    rcu_read_unlock();
+    return ret;
 }
 
 int read_block(dev_t dev, blkcnt_t blk, char *buf)
 {
-    if (!block_drivers[MAJOR(dev)])
-        return -ENODEV;
-    
-    return block_drivers[MAJOR(dev)]->readblk(dev, blk, buf);
+    rcu_read_lock();
+    struct block_driver *dr = rcu_dereference(block_drivers[MAJOR(dev)]);
+    int ret = dr ? dr->readblk(dev, blk, buf) : -ENODEV;
+    rcu_read_unlock();
+    return ret;
 }
+
 int write_block(dev_t dev, blkcnt_t blk, const char *buf)
 {
-    if (!block_drivers[MAJOR(dev)])
-        return -ENODEV;
-    
-    return block_drivers[MAJOR(dev)]->writeblk(dev, blk, buf);
+    rcu_read_lock();
+    struct block_driver *dr = rcu_dereference(block_drivers[MAJOR(dev)]);
+    int ret = dr ? dr->writeblk(dev, blk, buf) : -ENODEV;
+    rcu_read_unlock();
+    return ret;
 }
@@ -5,11 +5,15 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <errno.h>
 #include <stdio.h>
-#include <string.h>
 
 #include <drivers/tty.h>
 
+#include "ring.h"
+#include "spinlock.h"
+#include "wait.h"
+
 #define VC_KEY_QUEUE_LEN 256
 
 static char keycode_to_char[2][256] = {{
@@ -38,23 +42,41 @@ static char keycode_to_char[2][256] = {{
     0, 0, 0, 0, '0', '.'
 }};
 
-static char input_queue[VC_KEY_QUEUE_LEN];
-static size_t queue_idx = 0;
+/* Function keys F1..F8 */
+#define KEY_F1 0x01
+#define KEY_F8 0x08
+
+/* One input queue per virtual console, keys go to the one in the
+ * foreground. The keyboard interrupt handler is the only producer. Several
+ * threads may read the same console though, so readers take `read_lock` to
+ * stay a single consumer. */
+static RING(char, VC_KEY_QUEUE_LEN) input_queue[NUM_VCONSOLES];
+static struct wait_queue input_wait[NUM_VCONSOLES];
+static struct spinlock read_lock = SPINLOCK_INIT("kb_read");
 
 static uint8_t modifiers;
 
-int vconsole_read(char *buf, size_t n)
+int vconsole_read(int vc, char *buf, size_t n)
 {
-    n = queue_idx < n ? queue_idx : n;
-
-    /* Pass on `n` characters from queue. */
-    memcpy(buf, input_queue, n);
+    if (vc == VC_FOREGROUND)
+        vc = vconsole_foreground();
+    if (vc < 0 || vc >= NUM_VCONSOLES)
+        return -ENODEV;
+
+    irqflags_t flags = spin_lock_irqsave(&read_lock);
+    int ret = ring_read(&input_queue[vc], buf, n);
+    spin_unlock_irqrestore(&read_lock, flags);
+    return ret;
+}
 
-    /* Move rest of queue forward. */
-    memmove(input_queue, &input_queue[n], queue_idx - n);
-    queue_idx -= n;
+struct wait_queue *vconsole_read_queue(int vc)
+{
+    if (vc == VC_FOREGROUND)
+        vc = vconsole_foreground();
+    if (vc < 0 || vc >= NUM_VCONSOLES)
+        return NULL;
 
-    return n;
+    return &input_wait[vc];
 }
 
 void kb_key_pressed(uint8_t keycode)
@@ -84,6 +106,12 @@ void kb_key_pressed(uint8_t keycode)
         kb_set_mod(CAPS, !kb_get_mod(CAPS));
         break;
     default:
+        /* Alt+Fn switches to virtual console n. */
+        if (kb_get_mod(ALT) && keycode >= KEY_F1 && keycode <= KEY_F8) {
+            vconsole_switch(keycode - KEY_F1);
+            return;
+        }
+
         shift = kb_get_mod(SHIFT) ^ kb_get_mod(CAPS);
         ch = keycode_to_char[shift][keycode];
 
@@ -96,15 +124,13 @@ void kb_key_pressed(uint8_t keycode)
             ch &= 0x1f;
         
         /*
-         * Enqueue character. If queue is full, throw away very old inputs.
-         * Those are probably void as no one has bothered to read them for 256
-         * keystrokes.
+         * Enqueue character. If the queue is full, the key is lost: no one
+         * has bothered to read the last 256 keystrokes, and only the reader
+         * may make room.
          */
-        if (queue_idx >= VC_KEY_QUEUE_LEN) {
-            memmove(input_queue, &input_queue[1], queue_idx - 1);
-            queue_idx--;
-        }
-        input_queue[queue_idx++] = ch;
+        int vc = vconsole_foreground();
+        if (ring_push(&input_queue[vc], ch))
+            wake_up(&input_wait[vc]);
     }
 }
 
@@ -1,24 +1,38 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic.h>
 #include <drivers/driver.h>
 
 #include "fs.h"
+#include "rcu.h"
+#include "spinlock.h"
 
 #define TMPFS_BLK_SIZE 4096
 
 extern struct fs_driver tmpfs_driver;
 
+/* Directory lists are walked under RCU, so lookups take no lock. Changes to
+ * them are serialized by `dir_lock`. The directory holds a reference to each
+ * of its entries, and every lookup that returned it one more: an entry is
+ * freed a grace period after the last one is dropped, so a walker in a read
+ * section that already found a count of 0 can't see it freed either. */
 struct tmpfs_dentry {
     struct dentry base;
     struct tmpfs_dentry *next;
+    volatile uint32_t refs;
+    struct rcu_head rcu;
 };
 
+static struct spinlock dir_lock = SPINLOCK_INIT("tmpfs_dir");
+
 struct tmpfs_idir {
     struct inode base;
     struct tmpfs_dentry *first;
@@ -34,10 +48,12 @@ struct tmpfs_ifile {
     struct tmpfs_blk firstblk;
 };
 
-static void add_to_dir(struct tmpfs_idir *dir, const char *name,
+/* Links `ino` into `dir` as `name`. Fails with -EEXIST if the name is taken,
+ * checked under `dir_lock` so that of two creates only one succeeds. */
+static int add_to_dir(struct tmpfs_idir *dir, const char *name,
         struct inode *ino)
 {
-    char *name_buf = malloc(strlen(name));
+    char *name_buf = malloc(strlen(name) + 1);
     strcpy(name_buf, name);
 
     struct tmpfs_dentry *de = malloc(sizeof(struct tmpfs_dentry));
@@ -46,17 +62,85 @@ static void add_to_dir(struct tmpfs_idir *dir, const char *name,
     de->base.ino = ino;
 
     de->next = NULL;
+    de->refs = 1;
+
+    irqflags_t flags = spin_lock_irqsave(&dir_lock);
+
+    struct tmpfs_dentry **pp;
+    for (pp = &dir->first; *pp; pp = &(*pp)->next) {
+        if (!strcmp((*pp)->base.name, name)) {
+            spin_unlock_irqrestore(&dir_lock, flags);
+            free(name_buf);
+            free(de);
+            return -EEXIST;
+        }
+    }
 
     ino->nlink++;
 
-    if (dir->first == NULL){
-        dir->first = de;
-    } else {
-        struct tmpfs_dentry *last;
-        for (last = dir->first; last->next != NULL; last = last->next)
-            ;
-        last->next = de;
+    /* Readers may see the new entry as soon as it's linked in. */
+    rcu_assign_pointer(*pp, de);
+
+    spin_unlock_irqrestore(&dir_lock, flags);
+    return 0;
+}
+
+/* Frees a directory that never got linked in, along with its "." and "..". */
+static void free_new_dir(struct tmpfs_idir *d, struct inode *parent)
+{
+    irqflags_t flags = spin_lock_irqsave(&dir_lock);
+    parent->nlink--;
+    spin_unlock_irqrestore(&dir_lock, flags);
+
+    struct tmpfs_dentry *de = d->first;
+    while (de) {
+        struct tmpfs_dentry *next = de->next;
+        free((char *)de->base.name);
+        free(de);
+        de = next;
     }
+    free(d);
+}
+
+static void free_dentry(struct rcu_head *head)
+{
+    struct tmpfs_dentry *de = (struct tmpfs_dentry *)
+        ((char *)head - offsetof(struct tmpfs_dentry, rcu));
+    struct inode *ino = de->base.ino;
+
+    free((char *)de->base.name);
+    free(de);
+
+    if (ino->nlink)
+        return;
+
+    if ((ino->mode & IT_TYPE) == IT_REG) {
+        struct tmpfs_blk *blk = ((struct tmpfs_ifile *)ino)->firstblk.nextblk;
+        while (blk) {
+            struct tmpfs_blk *next = blk->nextblk;
+            free(blk);
+            blk = next;
+        }
+    }
+    free(ino);
+}
+
+static void put_dentry(struct tmpfs_dentry *de)
+{
+    if (atomic_fetch_add(&de->refs, -1) == 1)
+        call_rcu(&de->rcu, free_dentry);
+}
+
+/* Takes a reference, unless the entry is on its way out already. */
+static bool get_dentry(struct tmpfs_dentry *de)
+{
+    uint32_t refs;
+    do {
+        refs = de->refs;
+        if (!refs)
+            return false;
+    } while (!cmpxchg(&de->refs, refs, refs + 1));
+    return true;
 }
 
 static struct tmpfs_blk *find_blk(struct tmpfs_ifile *file, off_t pos)
@@ -102,14 +186,53 @@ void tmpfs_destroy(struct fs_instance *fs)
 
 struct dentry *tmpfs_lookup(struct inode *idir, const char *name)
 {
+    struct tmpfs_idir *dir = (struct tmpfs_idir *)idir;
     struct tmpfs_dentry *de;
-    
-    for (de = ((struct tmpfs_idir *)idir)->first; de != NULL; de = de->next) {
-        if (strcmp(de->base.name, name) == 0)
-            return &de->base;
+
+    rcu_read_lock();
+    for (de = rcu_dereference(dir->first); de != NULL;
+            de = rcu_dereference(de->next)) {
+        if (strcmp(de->base.name, name) == 0 && get_dentry(de))
+            break;
     }
+    rcu_read_unlock();
 
-    return NULL;
+    return de ? &de->base : NULL;
+}
+
+void tmpfs_put(struct dentry *de)
+{
+    put_dentry((struct tmpfs_dentry *)de);
+}
+
+int tmpfs_unlink(struct inode *idir, const char *name)
+{
+    struct tmpfs_idir *dir = (struct tmpfs_idir *)idir;
+    struct tmpfs_dentry **pp, *de = NULL;
+
+    irqflags_t flags = spin_lock_irqsave(&dir_lock);
+
+    for (pp = &dir->first; *pp != NULL; pp = &(*pp)->next) {
+        if (strcmp((*pp)->base.name, name) == 0) {
+            de = *pp;
+            break;
+        }
+    }
+
+    if (!de || (de->base.ino->mode & IT_TYPE) == IT_DIR) {
+        spin_unlock_irqrestore(&dir_lock, flags);
+        return de ? -EISDIR : -ENOENT;
+    }
+
+    /* Readers on the entry still find their way on through its `next`. */
+    rcu_assign_pointer(*pp, de->next);
+    de->base.ino->nlink--;
+
+    spin_unlock_irqrestore(&dir_lock, flags);
+
+    /* The directory's reference */
+    put_dentry(de);
+    return 0;
 }
 
 int tmpfs_create(struct inode *idir, const char *name, mode_t mode)
@@ -117,9 +240,7 @@ int tmpfs_create(struct inode *idir, const char *name, mode_t mode)
     struct tmpfs_ifile *f;
     struct tmpfs_idir *d;
     struct inode *nod;
-
-    if (tmpfs_lookup(idir, name))
-        return -EEXIST;
+    int err;
 
     switch (mode & IT_TYPE) {
     case IT_REG:
@@ -136,9 +257,10 @@ int tmpfs_create(struct inode *idir, const char *name, mode_t mode)
         memset(f->firstblk.buf, 0, TMPFS_BLK_SIZE);
         f->firstblk.nextblk = NULL;
 
-        add_to_dir((struct tmpfs_idir *)idir, name, &f->base);
-
-        return 0;
+        err = add_to_dir((struct tmpfs_idir *)idir, name, &f->base);
+        if (err)
+            free(f);
+        return err;
     
     case IT_DIR:
         d = malloc(sizeof(struct tmpfs_idir));
@@ -155,9 +277,10 @@ int tmpfs_create(struct inode *idir, const char *name, mode_t mode)
 
         add_to_dir(d, ".", &d->base);
         add_to_dir(d, "..", idir);
-        add_to_dir((struct tmpfs_idir *)idir, name, &d->base);
-
-        return 0;
+        err = add_to_dir((struct tmpfs_idir *)idir, name, &d->base);
+        if (err)
+            free_new_dir(d, idir);
+        return err;
     
     case IT_CHR:
     case IT_BLK:
@@ -170,28 +293,35 @@ int tmpfs_create(struct inode *idir, const char *name, mode_t mode)
         nod->gid = 0;
         nod->dev_type = 0;
 
-        add_to_dir((struct tmpfs_idir *)idir, name, nod);
-
-        return 0;
+        err = add_to_dir((struct tmpfs_idir *)idir, name, nod);
+        if (err)
+            free(nod);
+        return err;
 
     default:
         return -EPERM;
     }
 }
 
-int tmpfs_readdir(struct inode *idir, char **names, size_t n)
+int tmpfs_readdir(struct inode *idir, struct dirent *ents, size_t n)
 {
     size_t count = 0;
 
     struct tmpfs_dentry *de;
 
-    for (de = ((struct tmpfs_idir *)idir)->first; de != NULL; de = de->next) {
+    /* Names are copied out, they may be freed once we leave the section. */
+    rcu_read_lock();
+    for (de = rcu_dereference(((struct tmpfs_idir *)idir)->first); de != NULL;
+            de = rcu_dereference(de->next)) {
         if (count >= n)
             break;
         
-        *(names++) = (char *)de->base.name;
+        strncpy(ents->name, de->base.name, NAME_MAX);
+        ents->name[NAME_MAX] = 0;
+        ents++;
         count++;
     }
+    rcu_read_unlock();
     return count;
 }
 
@@ -308,6 +438,8 @@ struct fs_driver tmpfs_driver = {
     .destroy = tmpfs_destroy,
     .create = tmpfs_create,
     .lookup = tmpfs_lookup,
+    .put = tmpfs_put,
+    .unlink = tmpfs_unlink,
     .readdir = tmpfs_readdir,
     .write = tmpfs_write,
     .read = tmpfs_read,
@@ -0,0 +1,289 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/ftrace.c
+ *
+ * Function tracer. The hooks run on every function call, so they (and
+ * everything they call) must not be instrumented themselves, or they would
+ * recurse: they are marked `no_instrument_function`, and the Makefile excludes
+ * the inline helpers in headers.
+ *
+ * Every CPU writes only its own ring, reserving a slot with a plain increment
+ * while interrupts are off (interrupt handlers are the only other writers on
+ * the same CPU), so no locks and no atomic instructions are needed.
+ * see also: kernel/include/ftrace.h
+ */
+
+#include "ftrace.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <barrier.h>
+#include <cycles.h>
+#include <initcall.h>
+#include <irqflags.h>
+#include <percpu.h>
+#include <drivers/driver.h>
+#include <drivers/major.h>
+
+#include "spinlock.h"
+
+#define NO_TRACE __attribute__((no_instrument_function))
+
+#define FTRACE_RING_MASK (FTRACE_RING_SIZE - 1)
+
+_Static_assert((FTRACE_RING_SIZE & FTRACE_RING_MASK) == 0,
+    "FTRACE_RING_SIZE must be a power of two");
+
+enum ftrace_type {
+    FTRACE_ENTER,
+    FTRACE_EXIT,
+};
+
+struct ftrace_entry {
+    uint64_t tsc;
+    void *fn;
+    void *caller;
+    uint32_t type;
+};
+
+struct ftrace_cpu {
+    struct ftrace_entry *buf;
+    /* Only ever grow. The oldest entry kept is at head - FTRACE_RING_SIZE. */
+    volatile uint32_t head;
+    uint32_t tail; /* next to read */
+} __attribute__((aligned(64)));
+
+static struct ftrace_cpu ftrace_cpus[NR_CPUS];
+
+static volatile bool enabled;
+
+static void *volatile filters[FTRACE_MAX_FILTERS];
+static volatile unsigned nr_filters;
+
+/* Serializes filter changes and readers */
+static struct spinlock ftrace_lock = SPINLOCK_INIT("ftrace");
+
+/* "<cpu> <type> <tsc> <fn> <caller>\n" */
+#define ENTRY_LINE_LEN (3 + 2 + 17 + 9 + 9 + 1)
+
+static inline NO_TRACE bool filtered_out(void *fn)
+{
+    unsigned n = nr_filters;
+    if (!n)
+        return false;
+
+    for (unsigned i = 0; i < n; i++) {
+        if (filters[i] == fn)
+            return false;
+    }
+    return true;
+}
+
+static inline NO_TRACE void record(void *fn, void *caller,
+        enum ftrace_type type)
+{
+    if (filtered_out(fn))
+        return;
+
+    irqflags_t flags = local_irq_save();
+
+    struct ftrace_cpu *fc = &ftrace_cpus[smp_processor_id()];
+    if (fc->buf) {
+        uint32_t head = fc->head;
+        struct ftrace_entry *e = &fc->buf[head & FTRACE_RING_MASK];
+        e->tsc = get_cycles();
+        e->fn = fn;
+        e->caller = caller;
+        e->type = type;
+        smp_store_release(&fc->head, head + 1);
+    }
+
+    local_irq_restore(flags);
+}
+
+NO_TRACE void __cyg_profile_func_enter(void *fn, void *caller)
+{
+    if (enabled)
+        record(fn, caller, FTRACE_ENTER);
+}
+
+NO_TRACE void __cyg_profile_func_exit(void *fn, void *caller)
+{
+    if (enabled)
+        record(fn, caller, FTRACE_EXIT);
+}
+
+bool ftrace_start()
+{
+#ifndef CONFIG_FTRACE
+    printf("err: ftrace: kernel built without FTRACE=1\n");
+    return false;
+#else
+    for (unsigned cpu = 0; cpu < num_online_cpus(); cpu++) {
+        struct ftrace_cpu *fc = &ftrace_cpus[cpu];
+        if (fc->buf)
+            continue;
+
+        fc->buf = malloc(FTRACE_RING_SIZE * sizeof(struct ftrace_entry));
+        if (!fc->buf) {
+            printf("err: ftrace: no memory for CPU %u's buffer\n", cpu);
+            return false;
+        }
+    }
+
+    smp_store_release(&enabled, true);
+    return true;
+#endif
+}
+
+void ftrace_stop()
+{
+    enabled = false;
+    /* Recording in progress elsewhere is done long before anyone reads. */
+    smp_mb();
+}
+
+bool ftrace_filter_add(void *fn)
+{
+    irqflags_t flags = spin_lock_irqsave(&ftrace_lock);
+
+    bool ok = nr_filters < FTRACE_MAX_FILTERS;
+    if (ok) {
+        filters[nr_filters] = fn;
+        smp_store_release(&nr_filters, nr_filters + 1);
+    }
+
+    spin_unlock_irqrestore(&ftrace_lock, flags);
+    return ok;
+}
+
+void ftrace_filter_clear()
+{
+    irqflags_t flags = spin_lock_irqsave(&ftrace_lock);
+    nr_filters = 0;
+    spin_unlock_irqrestore(&ftrace_lock, flags);
+}
+
+/* Copies whole entry lines into `buf`, oldest first, one CPU after another. */
+static size_t read_entries(char *buf, size_t n)
+{
+    char line[ENTRY_LINE_LEN + 1];
+    size_t count = 0;
+
+    irqflags_t flags = spin_lock_irqsave(&ftrace_lock);
+
+    for (unsigned cpu = 0; cpu < NR_CPUS; cpu++) {
+        struct ftrace_cpu *fc = &ftrace_cpus[cpu];
+        if (!fc->buf)
+            continue;
+
+        uint32_t head = smp_load_acquire(&fc->head);
+
+        /* Overwritten while we weren't looking */
+        if (head - fc->tail > FTRACE_RING_SIZE)
+            fc->tail = head - FTRACE_RING_SIZE;
+
+        for (; fc->tail != head; fc->tail++) {
+            struct ftrace_entry *e = &fc->buf[fc->tail & FTRACE_RING_MASK];
+            size_t len = snprintf(line, sizeof(line), "%u %c %llx %08x %08x\n",
+                cpu, e->type == FTRACE_ENTER ? 'e' : 'x', e->tsc,
+                (uint32_t)e->fn, (uint32_t)e->caller);
+            if (count + len > n)
+                goto out;
+
+            memcpy(&buf[count], line, len);
+            count += len;
+        }
+    }
+
+out:
+    spin_unlock_irqrestore(&ftrace_lock, flags);
+    return count;
+}
+
+void ftrace_dump()
+{
+    char buf[1024];
+    size_t n;
+
+    printf("ftrace: begin\n");
+    while ((n = read_entries(buf, sizeof(buf) - 1))) {
+        buf[n] = '\0';
+        printf("%s", buf);
+    }
+    printf("ftrace: end\n");
+}
+
+static int ftrace_read(dev_t dev, off_t pos, char *buf, size_t n)
+{
+    (void)dev;
+    (void)pos;
+    return read_entries(buf, n);
+}
+
+static uint32_t parse_hex(const char *s)
+{
+    uint32_t x = 0;
+
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        s += 2;
+
+    for (; *s; s++) {
+        char c = *s | 0x20; /* lower case */
+        if (c >= '0' && c <= '9')
+            x = x << 4 | (c - '0');
+        else if (c >= 'a' && c <= 'f')
+            x = x << 4 | (c - 'a' + 10);
+        else
+            break;
+    }
+    return x;
+}
+
+static int ftrace_write(dev_t dev, off_t pos, const char *buf, size_t n)
+{
+    (void)dev;
+    (void)pos;
+
+    char cmd[32];
+    size_t len = n < sizeof(cmd) - 1 ? n : sizeof(cmd) - 1;
+    memcpy(cmd, buf, len);
+    cmd[len] = '\0';
+
+    if (strncmp(cmd, "start", 5) == 0)
+        return ftrace_start() ? (int)n : -EINVAL;
+    if (strncmp(cmd, "stop", 4) == 0) {
+        ftrace_stop();
+        return n;
+    }
+    if (strncmp(cmd, "nofilter", 8) == 0) {
+        ftrace_filter_clear();
+        return n;
+    }
+    if (strncmp(cmd, "filter ", 7) == 0) {
+        uint32_t addr = parse_hex(&cmd[7]);
+        if (!addr)
+            return -EINVAL;
+        return ftrace_filter_add((void *)addr) ? (int)n : -ENOSPC;
+    }
+    return -EINVAL;
+}
+
+static struct char_driver ftrace_driver = {
+    .read = ftrace_read,
+    .write = ftrace_write,
+};
+
+void ftrace_init()
+{
+    register_char_driver(CHR_FTRACE, &ftrace_driver);
+}
+
+core_initcall(ftrace_init);
@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include "idle.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <irqflags.h>
+#include <initcall.h>
+#include <drivers/procinfo.h>
+
+#include "ktime.h"
+#include "profile.h"
+#include "rcu.h"
+#include "softirq.h"
+#include "timer.h"
+
+/* Sleep durations are recorded in buckets of powers of two microseconds. */
+#define IDLE_HIST_BUCKETS 24
+
+static struct {
+    uint64_t entries;
+    uint64_t tickless;
+    uint64_t ns;
+    uint32_t hist[IDLE_HIST_BUCKETS];
+} stats;
+
+void cpu_idle()
+{
+    /* Raised while interrupts were being disabled, run it first. */
+    if (softirq_pending()) {
+        local_irq_enable();
+        return;
+    }
+
+    /* The profiler samples (all CPUs) on the tick. */
+    bool tickless = !profile_enabled() && tick_nohz_stop();
+    uint64_t start = ktime_get_ns();
+
+    rcu_idle_enter();
+    arch_safe_halt();
+
+    local_irq_disable();
+    rcu_idle_exit();
+
+    /* Not every wakeup goes through the IRQ layer (NMIs, for one). */
+    tick_nohz_restart();
+
+    uint64_t ns = ktime_get_ns() - start;
+    uint32_t us = ns / NSEC_PER_USEC > UINT32_MAX ? UINT32_MAX :
+        ns / NSEC_PER_USEC;
+    unsigned bucket = us ? 31 - __builtin_clz(us) : 0;
+
+    stats.entries++;
+    stats.tickless += tickless;
+    stats.ns += ns;
+    stats.hist[bucket < IDLE_HIST_BUCKETS ? bucket : IDLE_HIST_BUCKETS - 1]++;
+
+    local_irq_enable();
+}
+
+static void show_idle(struct seqbuf *s)
+{
+    irqflags_t flags = local_irq_save();
+    typeof(stats) snap = stats;
+    uint64_t skipped = tick_nohz_skipped();
+    uint64_t uptime = ktime_get_ns();
+    local_irq_restore(flags);
+
+    uint64_t idle_ms = snap.ns / NSEC_PER_MSEC;
+    uint64_t up_ms = uptime / NSEC_PER_MSEC;
+
+    seq_printf(s, "uptime: %llu ms\n", up_ms);
+    seq_printf(s, "idle: %llu ms (%llu%%)\n", idle_ms,
+        up_ms ? idle_ms * 100 / up_ms : 0);
+    seq_printf(s, "idle entries: %llu, tickless: %llu\n", snap.entries,
+        snap.tickless);
+    seq_printf(s, "ticks skipped: %llu\n", skipped);
+    seq_printf(s, "\nResidency, log2 buckets (2^n us: count):\n");
+
+    for (unsigned b = 0; b < IDLE_HIST_BUCKETS; b++) {
+        if (snap.hist[b])
+            seq_printf(s, " 2^%u:%u", b, snap.hist[b]);
+    }
+    seq_printf(s, "\n");
+}
+
+void idle_procinfo_setup()
+{
+    register_procinfo(PROCINFO_IDLE, show_idle);
+}
+
+core_initcall(idle_procinfo_setup);
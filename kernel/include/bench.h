@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/bench.h
+ *
+ * @brief In-kernel benchmarks and their results
+ *
+ * Benchmarks run at boot, picked with `bench=<name>` on the kernel command
+ * line. Their results go to the console (and so COM1) as lines of the form
+ *
+ * @code
+ * bench: result <name> <value> <unit> <higher|lower>
+ * @endcode
+ *
+ * where the last field says which way is better, followed by a single
+ * `bench: done` once all of them ran. tools/bench.py (`make bench`) collects
+ * these into JSON and compares them against a baseline.
+ *
+ * Microbenchmarks are registered with `BENCHMARK(name, fn)`: `fn(iters)` does
+ * the operation measured `iters` times. The runner finds an iteration count
+ * that takes long enough to time, warms up, then times BENCH_SAMPLES batches
+ * and reports the minimum, median and 99th percentile cycles per iteration as
+ * `<name>.min`, `<name>.median` and `<name>.p99`.
+ *
+ * Benchmarks that measure something else (throughput, say) are registered
+ * with `BENCHMARK_RUN(name, fn)`: `fn()` runs once and reports its own
+ * results with `bench_report()`.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Batches timed per benchmark, after BENCH_WARMUP untimed ones */
+#define BENCH_SAMPLES 500
+#define BENCH_WARMUP 20
+
+/* Iterations per batch double until a batch takes at least this long. */
+#define BENCH_BATCH_CYCLES 100000
+
+enum bench_better {
+    BENCH_HIGHER_IS_BETTER,
+    BENCH_LOWER_IS_BETTER,
+};
+
+typedef void (*bench_f)(uint32_t iters);
+typedef void (*bench_run_f)(void);
+
+/* One of `fn` and `run` is set. */
+struct benchmark {
+    const char *name;
+    bench_f fn;
+    bench_run_f run;
+} __attribute__((aligned(4)));
+
+#define __define_benchmark(name, fn, run) \
+    static const struct benchmark __bench_##name \
+        __attribute__((used, section(".bench"))) = { #name, fn, run }
+
+/* Registers `fn` as `bench=<name>`, where `name` is an identifier. Like
+ * initcalls, descriptors are collected in a section of their own. */
+#define BENCHMARK(name, fn) __define_benchmark(name, fn, NULL)
+#define BENCHMARK_RUN(name, run) __define_benchmark(name, NULL, run)
+
+/**
+ * @brief Runs the benchmarks named with `bench=<name>` in `cmdline`
+ */
+void bench_run(const char *cmdline);
+
+/**
+ * @brief Prints a result, `name` without spaces (e.g. "vconsole.text")
+ */
+void bench_report(const char *name, uint64_t value, const char *unit,
+    enum bench_better better);
+
+#endif
@@ -3,16 +3,36 @@
 #define DRIVER_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "types.h"
 
 struct char_driver {
+    /* Never blocks, returns 0 if there is nothing to read (yet). */
     int (*read)(dev_t, off_t, char *, size_t);
     int (*write)(dev_t, off_t, const char *, size_t);
+
+    /* Optional, for devices whose input arrives over time: the wait queue
+     * woken when there may be something new to read. */
+    struct wait_queue *(*read_queue)(dev_t);
 };
 
 void register_char_driver(unsigned char major, struct char_driver *dr);
+/* Once this returns, the driver isn't called anymore. Sleeps. */
+void unregister_char_driver(unsigned char major);
+
+/*
+ * Reads from a character device, waiting for input for at most `timeout_ms`
+ * milliseconds if there is none yet (and the device has a read queue). 0 means
+ * don't wait, `WAIT_FOREVER` (kernel/include/wait.h) to wait until there is.
+ * Returns 0 on timeout.
+ */
+int read_char_timeout(dev_t dev, off_t pos, char *buf, size_t n,
+        uint32_t timeout_ms);
+
+/* Waits until there is input */
 int read_char(dev_t dev, off_t pos, char *buf, size_t n);
+int read_char_nonblock(dev_t dev, off_t pos, char *buf, size_t n);
 int write_char(dev_t dev, off_t pos, const char *buf, size_t n);
 
 struct block_driver {
@@ -22,6 +42,8 @@ struct block_driver {
 };
 
 void register_block_driver(unsigned char major, struct block_driver *dr);
+/* Once this returns, the driver isn't called anymore. Sleeps. */
+void unregister_block_driver(unsigned char major);
 blksize_t getblksize(dev_t dev);
 int read_block(dev_t dev, blkcnt_t blk, char *buf);
 int write_block(dev_t dev, blkcnt_t blk, const char *buf);
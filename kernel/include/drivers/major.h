@@ -10,6 +10,9 @@
 
 #define CHR_MEMDEV 1
 #define CHR_TTY 2
+#define CHR_PROCINFO 3
+#define CHR_PROFILE 4
+#define CHR_FTRACE 5
 
 #define BLK_RAMDISK 1
 
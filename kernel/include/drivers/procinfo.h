@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/drivers/procinfo.h
+ *
+ * @brief Kernel statistics as read-only character devices
+ *
+ * Every minor number of `CHR_PROCINFO` is a text report generated on each
+ * read, similar to the files in Linux's /proc. Subsystems register a function
+ * that writes the report.
+ */
+#ifndef PROCINFO_H
+#define PROCINFO_H
+
+#include <stddef.h>
+
+/* Minor numbers */
+
+#define PROCINFO_INTERRUPTS 1
+#define PROCINFO_IDLE 2
+#define PROCINFO_THREADS 3
+#define PROCINFO_WORKQUEUE 4
+#define PROCINFO_LOCKSTAT 5
+#define PROCINFO_RCU 6
+#define PROCINFO_LATENCY 7
+
+#define NUM_PROCINFO 16
+
+/**
+ * @brief Output buffer of a report
+ */
+struct seqbuf {
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+/**
+ * @brief Appends formatted text to a report
+ *
+ * Output that doesn't fit is dropped.
+ */
+int seq_printf(struct seqbuf *s, const char *format, ...);
+
+typedef void (*procinfo_show_f)(struct seqbuf *s);
+
+/**
+ * @brief Makes `show` generate the report of minor number `minor`
+ */
+void register_procinfo(unsigned minor, procinfo_show_f show);
+
+#endif
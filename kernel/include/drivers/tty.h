@@ -12,12 +12,42 @@
 
 #include <stddef.h>
 
+#define NUM_VCONSOLES 8
+
+/* Pass as virtual console number to address whichever is on screen. */
+#define VC_FOREGROUND (-1)
+
 void tty_init(void);
 
-int vconsole_read(char *buf, size_t n);
-int vconsole_write(const char *buf, size_t n);
+/*
+ * Virtual consoles, numbered 0..NUM_VCONSOLES-1. Console 0 is the system
+ * console, which kernel messages (`printf()`) go to. Keyboard input goes to
+ * the console in the foreground, Alt+F1..F8 brings another one to the front.
+ */
+int vconsole_read(int vc, char *buf, size_t n);
+int vconsole_write(int vc, const char *buf, size_t n);
+
+/* Woken when a key is queued for `vc`. */
+struct wait_queue *vconsole_read_queue(int vc);
+
+int vconsole_foreground(void);
+void vconsole_switch(int vc);
 
 int serial_read(int port, char *buf, size_t n);
 int serial_write(int port, const char *buf, size_t n);
 
+/* Woken when bytes are received on `port`. */
+struct wait_queue *serial_read_queue(int port);
+
+/*
+ * Kernel messages also go to serial port `port` (1 for COM1) from now on, with
+ * `console=serial` on the command line. Output to it waits for the port, so
+ * none is lost, and can be captured e.g. with QEMU's `-serial` option.
+ */
+void serial_console_init(int port);
+void serial_console_write(const char *buf, size_t n);
+
+/* Writes kernel messages: to console 0 and the serial console, if any. */
+int console_write(const char *buf, size_t n);
+
 #endif
@@ -82,6 +82,13 @@ struct dentry {
     struct inode *ino;
 };
 
+/* Longest name `readdir` copies out, longer ones are cut off. */
+#define NAME_MAX 255
+
+struct dirent {
+    char name[NAME_MAX + 1];
+};
+
 struct file;
 
 struct fs_driver {
@@ -89,8 +96,15 @@ struct fs_driver {
     void (*destroy)(struct fs_instance *);
 
     int (*create)(struct inode *, const char *, mode_t);
+    /* Returns the entry with a reference held, drop it with `put`. Lookups
+     * don't block unlinking, an unlinked entry is freed once the last
+     * reference is gone. */
     struct dentry *(*lookup)(struct inode *, const char *);
-    int (*readdir)(struct inode *, char **, size_t);
+    void (*put)(struct dentry *);
+    /* Removes a non-directory entry. */
+    int (*unlink)(struct inode *, const char *);
+    /* Copies out up to `n` entries, returns how many. */
+    int (*readdir)(struct inode *, struct dirent *, size_t);
     int (*write)(struct inode *, off_t, const char *, size_t);
     int (*read)(struct inode *, off_t, char *, size_t);
 };
@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/ftrace.h
+ *
+ * @brief Function entry/exit tracer
+ *
+ * Built with `make FTRACE=1`, every kernel function (but the inline helpers in
+ * headers) calls the tracer on entry and exit, through GCC's
+ * `-finstrument-functions`. While tracing is off, that costs a load and a
+ * branch per call. While on, each CPU records `(tsc, function, caller)` into
+ * its own ring buffer, overwriting the oldest entries when full.
+ *
+ * The trace device (major CHR_FTRACE) accepts these commands:
+ *
+ * @code
+ * start              start tracing
+ * stop               stop tracing
+ * filter <address>   only trace this function (and others added the same way)
+ * nofilter           trace all functions again
+ * @endcode
+ *
+ * and reads as one line per entry (all numbers in hex):
+ *
+ * @code
+ * <cpu> <e|x> <tsc> <function> <caller>
+ * @endcode
+ *
+ * tools/ftrace-report.py turns a trace into per-function inclusive and
+ * exclusive times. Read the trace only while stopped.
+ */
+#ifndef FTRACE_H
+#define FTRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Entries kept per CPU, must be a power of two */
+#define FTRACE_RING_SIZE 8192
+
+#define FTRACE_MAX_FILTERS 16
+
+/**
+ * @brief Starts tracing
+ *
+ * @return false if the kernel wasn't built with FTRACE=1, or if out of
+ * memory for the buffers
+ */
+bool ftrace_start(void);
+
+void ftrace_stop(void);
+
+/**
+ * @brief Restricts tracing to `fn` (and the other functions added)
+ *
+ * @return false if there are too many filters
+ */
+bool ftrace_filter_add(void *fn);
+
+void ftrace_filter_clear(void);
+
+/**
+ * @brief Prints all unread entries to the console, between "ftrace: begin"
+ * and "ftrace: end" lines
+ */
+void ftrace_dump(void);
+
+#endif
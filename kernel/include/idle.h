@@ -0,0 +1,20 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/idle.h
+ *
+ * @brief What the CPU does when there is nothing to do
+ */
+#ifndef IDLE_H
+#define IDLE_H
+
+/**
+ * @brief Sleeps until the next interrupt
+ *
+ * Call with interrupts disabled, after checking there really is nothing to do
+ * (so an interrupt arriving in between can't be missed). Stops the periodic
+ * tick while sleeping if no timer needs it. Returns with interrupts enabled,
+ * after the interrupt that woke us (and its softirqs) was handled.
+ */
+void cpu_idle(void);
+
+#endif
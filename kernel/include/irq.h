@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/irq.h
+ *
+ * @brief Device interrupt (IRQ) handling
+ *
+ * All IRQ lines enter through `handle_irq()`, which runs every handler
+ * registered on the line, acknowledges the interrupt controller and keeps
+ * statistics. Handlers run with interrupts disabled and should defer longer
+ * work to a softirq.
+ */
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Lines the IRQ entry stubs exist for (vectors 0x20-0x3f). The interrupt
+ * controller may have fewer. */
+#define NR_IRQS 32
+
+/* Handler durations are recorded in buckets of powers of two cycles. */
+#define IRQ_HIST_BUCKETS 32
+
+enum irq_return {
+    IRQ_NONE,    /* not our device */
+    IRQ_HANDLED,
+};
+
+typedef enum irq_return (*irq_handler_f)(unsigned irq, void *data);
+
+/* Interrupt controller operations, provided by the architecture. */
+struct irq_chip {
+    const char *name;
+    unsigned nr_irqs;
+    unsigned vector_base; /* CPU vector of line 0 */
+    void (*mask)(unsigned irq);
+    void (*unmask)(unsigned irq);
+    void (*eoi)(unsigned irq);
+
+    /* Optional. Whether an interrupt on `irq` had no request behind it. Then
+     * this acknowledges whatever needs it, and no handlers or `eoi` run. */
+    bool (*spurious)(unsigned irq);
+};
+
+struct irq_action {
+    struct irq_action *next;
+    irq_handler_f handler;
+    void *data;
+};
+
+struct irq_desc {
+    struct irq_action *actions;
+
+    /* Interrupts received. */
+    uint64_t count;
+
+    /* Interrupts no handler claimed. */
+    uint32_t unhandled;
+
+    /* Interrupts the controller raised without a request (not counted in
+     * `count`). */
+    uint32_t spurious;
+
+    /* Cycles spent in the handlers (including EOI): total, maximum and
+     * histogram, bucket `n` counting durations of 2^n to 2^(n+1)-1. */
+    uint64_t cycles;
+    uint32_t max_cycles;
+    uint32_t hist[IRQ_HIST_BUCKETS];
+};
+
+/**
+ * @brief Registers an interrupt handler on line `irq`
+ *
+ * Lines can be shared, every handler must check whether its device actually
+ * raised the interrupt and return `IRQ_NONE` otherwise. The line is unmasked
+ * with the first handler. `data` is passed to the handler and identifies it
+ * for `free_irq()`.
+ *
+ * @return 0 on success, -EINVAL or -ENOMEM
+ */
+int request_irq(unsigned irq, irq_handler_f handler, void *data);
+
+/**
+ * @brief Removes the handler registered with `data` from line `irq`
+ *
+ * The line is masked once no handlers are left.
+ */
+void free_irq(unsigned irq, void *data);
+
+/**
+ * @brief Sets the interrupt controller driving the IRQ lines
+ */
+void irq_set_chip(const struct irq_chip *chip);
+
+/**
+ * @brief Name of the interrupt controller in use
+ */
+const char *irq_chip_name(void);
+
+/**
+ * @brief Returns line `irq`'s descriptor (for statistics), or NULL
+ */
+const struct irq_desc *irq_to_desc(unsigned irq);
+
+struct registers;
+
+/**
+ * @brief Common entry point for IRQ `irq`, called by the low-level stubs
+ *
+ * `regs` is what was interrupted, see `get_irq_regs()`.
+ */
+void handle_irq(unsigned irq, struct registers *regs);
+
+#endif
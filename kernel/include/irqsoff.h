@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/irqsoff.h
+ *
+ * @brief Interrupts-off and preemption-off latency tracer
+ *
+ * Every time a CPU disables interrupts (`local_irq_save()` and friends, or an
+ * interrupt gate on the way into a handler) the time stamp counter and the
+ * call site are noted. When it enables them again, the window is counted in a
+ * histogram, and kept if it's the longest one so far. Preemption-off windows
+ * (`preempt_disable()` to `preempt_enable()`, boot CPU only) are tracked the
+ * same way.
+ *
+ * The report is procinfo minor PROCINFO_LATENCY, with the worst windows'
+ * start and end addresses in hex (see `addr2line -f -e kernel/asternix.bin`).
+ * Boots with benchmarks also report the worst windows as benchmark results,
+ * so `make bench` catches latency regressions.
+ *
+ * The hooks are called from irqflags.h and sched.h and take no locks. They do
+ * nothing until `irqsoff_init()`, when every CPU has its per-CPU segment.
+ */
+#ifndef IRQSOFF_H
+#define IRQSOFF_H
+
+/**
+ * @brief Interrupts were just disabled, call with interrupts off
+ */
+void trace_hardirqs_off(void);
+
+/**
+ * @brief Interrupts are about to be enabled, call with interrupts still off
+ */
+void trace_hardirqs_on(void);
+
+/**
+ * @brief The current thread just became non-preemptible
+ */
+void trace_preempt_off(void);
+
+/**
+ * @brief The current thread is preemptible again, from `site` (since
+ * `preempt_enable()` isn't inline, it's not the caller)
+ */
+void trace_preempt_on(void *site);
+
+/**
+ * @brief Reports the longest windows since boot with `bench_report()`, as
+ * "irqsoff.max" (any CPU) and "irqsoff.preempt_max", in cycles
+ */
+void irqsoff_bench_report(void);
+
+#endif
@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/ktime.h
+ *
+ * @brief Monotonic time and clocksources
+ *
+ * A clocksource is a free-running counter of known frequency. The best one
+ * registered (highest rating) is used for `ktime_get_ns()`. Until anything
+ * better comes along, that is `jiffies`, with the resolution of one tick.
+ *
+ * Counter values are converted to nanoseconds as `(count * mult) >> shift`,
+ * so reading the time takes no division.
+ */
+#ifndef KTIME_H
+#define KTIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <cycles.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+struct clocksource {
+    const char *name;
+    int rating;
+
+    /* Reads the counter. NULL for the CPU cycle counter, which is read with
+     * the inline `get_cycles()` instead of a function call. */
+    uint64_t (*read)(void);
+
+    /* Counter frequency in Hz */
+    uint64_t freq;
+
+    /* Set by `clocksource_register()` */
+    uint32_t mult, shift;
+    uint64_t offset_ns;
+};
+
+/* Clocksource in use. */
+extern const struct clocksource *clocksource;
+
+/**
+ * @brief Converts a count of `cs` to nanoseconds
+ *
+ * The 64x32 bit product is split in two, so it doesn't overflow for long
+ * (about 2^32 * 2^(32 - shift) / mult seconds).
+ */
+static inline uint64_t clocksource_cyc2ns(const struct clocksource *cs,
+        uint64_t count)
+{
+    uint32_t hi = count >> 32, lo = count;
+    return (((uint64_t)hi * cs->mult) << (32 - cs->shift)) +
+        (((uint64_t)lo * cs->mult) >> cs->shift);
+}
+
+static inline uint64_t clocksource_read(const struct clocksource *cs)
+{
+    return cs->read ? cs->read() : get_cycles();
+}
+
+/**
+ * @brief Nanoseconds since boot, monotonic
+ */
+static inline uint64_t ktime_get_ns(void)
+{
+    const struct clocksource *cs = clocksource;
+    return clocksource_cyc2ns(cs, clocksource_read(cs)) + cs->offset_ns;
+}
+
+/**
+ * @brief Raw CPU cycle counter, the cheapest timestamp there is
+ *
+ * Convert differences with `cycles_to_ns()`.
+ */
+static inline uint64_t ktime_get_cycles(void)
+{
+    return get_cycles();
+}
+
+/**
+ * @brief Converts CPU cycles to nanoseconds
+ *
+ * Returns 0 if the cycle counter frequency isn't known.
+ */
+uint64_t cycles_to_ns(uint64_t cycles);
+
+/**
+ * @brief CPU cycle counter frequency in Hz, or 0 if not calibrated
+ */
+uint64_t cycles_freq(void);
+
+/**
+ * @brief Adds a clocksource, switching to it if it rates higher
+ *
+ * `cs->freq` must be set. Time continues from where the previous clocksource
+ * left off.
+ */
+void clocksource_register(struct clocksource *cs);
+
+#endif
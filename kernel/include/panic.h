@@ -4,6 +4,8 @@
 
 void panic(const char *format, ...);
 
-int panic_unwind(void **unwind_ptr);
+/* Stores up to `max` return addresses of the current call stack, innermost
+ * first. Returns how many. */
+int panic_unwind(void **entries, int max);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/profile.h
+ *
+ * @brief Sampling profiler
+ *
+ * While profiling, every timer tick records where the boot CPU was
+ * interrupted, along with its call chain, and has every other CPU do the same
+ * through an IPI. Samples are kept per CPU until read from the profile device
+ * (major CHR_PROFILE), one line per sample:
+ *
+ * @code
+ * <cpu> <address> <return address> <return address> ...
+ * @endcode
+ *
+ * all in hex, innermost first. Reads return whole lines only, and fail with
+ * -EINVAL if the buffer can't hold the longest one (about 150 bytes).
+ * tools/profile-fold.py turns these into folded stacks for flame graphs.
+ * Writing "start" or "stop" to the device starts or stops profiling.
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdbool.h>
+
+/* Call chain entries per sample, including the interrupted address */
+#define PROFILE_DEPTH 16
+
+/* Samples kept per CPU, must be a power of two. Further samples are dropped
+ * until read. */
+#define PROFILE_RING_SIZE 2048
+
+struct registers;
+
+/**
+ * @brief Starts sampling
+ *
+ * @return false if out of memory for the sample buffers
+ */
+bool profile_start(void);
+
+void profile_stop(void);
+
+bool profile_enabled(void);
+
+/**
+ * @brief Takes the samples of a tick, called from `timer_tick()`
+ */
+void profile_tick(void);
+
+/**
+ * @brief Records where `regs` interrupted the calling CPU
+ */
+void profile_sample(struct registers *regs);
+
+/**
+ * @brief Prints all unread samples to the console, between "profile: begin"
+ * and "profile: end" lines
+ */
+void profile_dump(void);
+
+#endif
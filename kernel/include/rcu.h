@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/rcu.h
+ *
+ * @brief Read-copy-update, for data that is read much more than written
+ *
+ * Readers take no locks and write no shared memory: they mark a read section
+ * with `rcu_read_lock()` / `rcu_read_unlock()` and follow pointers with
+ * `rcu_dereference()`. Writers publish new data with `rcu_assign_pointer()`
+ * (serialized among themselves by a lock), and may free what they unlinked
+ * only once every reader that could still see it is gone: after
+ * `synchronize_rcu()` returns, or in a `call_rcu()` callback.
+ *
+ * Readers can't sleep or be preempted, so every CPU passing through a context
+ * switch, an idle period or the space between two work items (a quiescent
+ * state) can't be in a read section it started before. A grace period ends
+ * once every CPU was quiescent.
+ */
+#ifndef RCU_H
+#define RCU_H
+
+#include <barrier.h>
+
+#include "sched.h"
+
+struct rcu_head {
+    struct rcu_head *next;
+    void (*fn)(struct rcu_head *);
+};
+
+/**
+ * @brief Starts a read section
+ *
+ * Sections nest, and can be used in interrupt handlers. Don't sleep in one.
+ */
+static inline void rcu_read_lock(void)
+{
+    preempt_disable();
+}
+
+static inline void rcu_read_unlock(void)
+{
+    preempt_enable();
+}
+
+/* Loads an RCU-protected pointer, in a read section (or holding the lock that
+ * serializes the writers). */
+#define rcu_dereference(p) smp_load_acquire(&(p))
+
+/* Publishes `v` in the RCU-protected pointer `p`, after everything `v` points
+ * to was initialized. */
+#define rcu_assign_pointer(p, v) smp_store_release(&(p), (v))
+
+/**
+ * @brief Waits until all read sections that started before have ended
+ *
+ * Call from a thread or a work item, not from an interrupt handler or a read
+ * section. Sleeps on the boot CPU, spins on the others.
+ */
+void synchronize_rcu(void);
+
+/**
+ * @brief Calls `fn(head)` after a grace period
+ *
+ * Doesn't wait, so it can be called from anywhere. Usually `head` is embedded
+ * in the object to free. Callbacks run in the "rcu" thread.
+ */
+void call_rcu(struct rcu_head *head, void (*fn)(struct rcu_head *));
+
+/**
+ * @brief Reports that the calling CPU is in no read section
+ */
+void rcu_note_qs(void);
+
+/**
+ * @brief Tells RCU the calling CPU goes idle and won't read until it's back
+ *
+ * Call with interrupts disabled, right before halting.
+ */
+void rcu_idle_enter(void);
+
+/**
+ * @brief The calling CPU is back from idle (or was just started)
+ */
+void rcu_idle_exit(void);
+
+/**
+ * @brief Called at the start of an interrupt, which may be taken while idle
+ */
+void rcu_irq_enter(void);
+
+/**
+ * @brief Wakes the callback thread, called by the wakeup IPI handler
+ */
+void rcu_kick(void);
+
+#endif
@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/ring.h
+ *
+ * @brief Lock-free single-producer/single-consumer ring buffers
+ *
+ * A ring holds a power-of-two number of elements of any type. `head` and
+ * `tail` run freely and are only masked when indexing, so `head - tail` is
+ * always the number of elements in the ring, even after wrapping around.
+ *
+ * Only the producer ever writes `head` and only the consumer ever writes
+ * `tail`. As long as there is at most one of each (e.g. an interrupt handler
+ * and a reader), no locking is needed: the producer publishes an element by
+ * advancing `head` after storing it, the consumer frees a slot by advancing
+ * `tail` after loading from it.
+ *
+ * @par Example
+ * @code
+ * static RING(char, 256) input;
+ *
+ * // in the interrupt handler
+ * ring_push(&input, ch);
+ *
+ * // in the reader
+ * n = ring_read(&input, buf, n);
+ * @endcode
+ */
+#ifndef RING_H
+#define RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <barrier.h>
+
+/**
+ * @brief Ring buffer type holding `size` elements of `type`
+ *
+ * `size` has to be a power of two. Zero-initialized rings are empty.
+ */
+#define RING(type, size) \
+    struct { \
+        uint32_t head; \
+        uint32_t tail; \
+        type buf[size]; \
+        _Static_assert(((size) & ((size) - 1)) == 0, \
+            "ring size must be a power of two"); \
+    }
+
+#define ring_size(r) (sizeof((r)->buf) / sizeof((r)->buf[0]))
+#define ring_slot(r, idx) (&(r)->buf[(idx) & (ring_size(r) - 1)])
+
+/** @brief Number of elements in the ring (exact only for producer/consumer) */
+#define ring_count(r) \
+    (smp_load_acquire(&(r)->head) - smp_load_acquire(&(r)->tail))
+
+#define ring_empty(r) (ring_count(r) == 0)
+#define ring_full(r) (ring_count(r) >= ring_size(r))
+
+/**
+ * @brief Appends `val` (producer only)
+ * @returns false if the ring is full
+ */
+#define ring_push(r, val) ({ \
+        uint32_t __head = (r)->head; \
+        bool __ok = __head - smp_load_acquire(&(r)->tail) < ring_size(r); \
+        if (__ok) { \
+            *ring_slot(r, __head) = (val); \
+            smp_store_release(&(r)->head, __head + 1); \
+        } \
+        __ok; \
+    })
+
+/**
+ * @brief Removes the oldest element into `*p` (consumer only)
+ * @returns false if the ring is empty
+ */
+#define ring_pop(r, p) ({ \
+        uint32_t __tail = (r)->tail; \
+        bool __ok = smp_load_acquire(&(r)->head) != __tail; \
+        if (__ok) { \
+            *(p) = *ring_slot(r, __tail); \
+            smp_store_release(&(r)->tail, __tail + 1); \
+        } \
+        __ok; \
+    })
+
+/**
+ * @brief The oldest element, or NULL if the ring is empty (consumer only)
+ *
+ * It stays in the ring until `ring_drop()`.
+ */
+#define ring_peek(r) ({ \
+        uint32_t __tail = (r)->tail; \
+        smp_load_acquire(&(r)->head) != __tail ? ring_slot(r, __tail) : NULL; \
+    })
+
+/** @brief Removes the oldest element, after `ring_peek()` (consumer only) */
+#define ring_drop(r) smp_store_release(&(r)->tail, (r)->tail + 1)
+
+/**
+ * @brief Appends up to `n` elements from `src` (producer only)
+ * @returns Number of elements appended
+ *
+ * Publishes all of them at once.
+ */
+#define ring_write(r, src, n) ({ \
+        uint32_t __head = (r)->head; \
+        size_t __free = ring_size(r) - \
+            (__head - smp_load_acquire(&(r)->tail)); \
+        size_t __n = (n) < __free ? (n) : __free; \
+        for (size_t __i = 0; __i < __n; __i++) \
+            *ring_slot(r, __head + __i) = (src)[__i]; \
+        smp_store_release(&(r)->head, __head + __n); \
+        __n; \
+    })
+
+/**
+ * @brief Removes up to `n` of the oldest elements into `dest` (consumer only)
+ * @returns Number of elements removed
+ */
+#define ring_read(r, dest, n) ({ \
+        uint32_t __tail = (r)->tail; \
+        size_t __avail = smp_load_acquire(&(r)->head) - __tail; \
+        size_t __n = (n) < __avail ? (n) : __avail; \
+        for (size_t __i = 0; __i < __n; __i++) \
+            (dest)[__i] = *ring_slot(r, __tail + __i); \
+        smp_store_release(&(r)->tail, __tail + __n); \
+        __n; \
+    })
+
+#endif
@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/sched.h
+ *
+ * @brief Kernel threads and the scheduler
+ *
+ * Every thread has its own stack. The runnable thread with the highest
+ * priority (lowest number) runs. Threads of equal priority take turns, each
+ * getting a time slice before it's preempted. Preemption happens on the way
+ * out of interrupts (after softirqs), or when re-enabling preemption.
+ */
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <irqsoff.h>
+#include <percpu.h>
+
+#include "timer.h"
+
+#define NR_PRIOS 32
+#define PRIO_HIGHEST 0
+#define PRIO_DEFAULT 16
+#define PRIO_LOWEST (NR_PRIOS - 1)
+
+#define THREAD_STACK_SIZE 8192
+#define THREAD_NAME_LEN 16
+
+#define TIMESLICE_MS 10
+
+#define MAX_SCHEDULE_TIMEOUT UINT32_MAX
+
+enum thread_state {
+    THREAD_RUNNING,
+    THREAD_READY,
+    THREAD_SLEEPING, /* until woken by `thread_wake()` */
+    THREAD_DEAD,
+};
+
+struct thread {
+    /* Saved stack pointer while switched out. */
+    void *sp;
+
+    /* Next in the run queue (while ready) */
+    struct thread *next;
+    /* Next in the list of all threads */
+    struct thread *all_next;
+
+    enum thread_state state;
+    uint8_t prio;
+    uint32_t slice; /* jiffies left */
+    int preempt_count;
+
+    int tid;
+    char name[THREAD_NAME_LEN];
+
+    void *stack; /* NULL for the boot thread */
+    void (*fn)(void *);
+    void *arg;
+
+    struct timer sleep_timer;
+
+    uint64_t switches;
+    uint64_t runtime_ns;
+};
+
+/**
+ * @brief The thread we are running on
+ */
+extern struct thread *current;
+
+/**
+ * @brief Turns the boot code into the first thread and starts the idle thread
+ *
+ * Call once, after `timer_init()`.
+ */
+void sched_init(void);
+
+/**
+ * @brief Starts a thread running `fn(arg)`
+ *
+ * Returning from `fn` ends the thread.
+ *
+ * @return The new thread, or NULL if out of memory
+ */
+struct thread *thread_create(const char *name, unsigned prio,
+        void (*fn)(void *), void *arg);
+
+/**
+ * @brief Ends the current thread
+ */
+__attribute__((noreturn)) void thread_exit(void);
+
+/**
+ * @brief Makes a sleeping thread runnable again
+ *
+ * Safe to call from interrupt handlers. Does nothing if it isn't sleeping.
+ */
+void thread_wake(struct thread *t);
+
+/**
+ * @brief Switches to the next thread to run
+ *
+ * If the current thread isn't `THREAD_RUNNING` anymore, it is not put back
+ * onto the run queue, which is how threads go to sleep: set the state with
+ * interrupts disabled (so the wakeup can't come first), then call this.
+ */
+void schedule(void);
+
+/**
+ * @brief Like `schedule()`, but wakes up after `ticks` jiffies at the latest
+ *
+ * `MAX_SCHEDULE_TIMEOUT` waits until woken.
+ */
+void schedule_timeout(uint32_t ticks);
+
+/**
+ * @brief Lets other threads of the same priority run
+ */
+void yield(void);
+
+/**
+ * @brief Sleeps for at least `ms` milliseconds
+ */
+void msleep(uint32_t ms);
+
+/**
+ * @brief Whether a thread other than the current one should run
+ */
+bool need_resched(void);
+
+/**
+ * @brief Keeps the current thread from being preempted until
+ * `preempt_enable()`
+ *
+ * Calls nest. Interrupts still come in. Only the boot CPU runs threads, on
+ * the others there is nothing to preempt.
+ */
+static inline void preempt_disable(void)
+{
+    if (smp_processor_id() != 0)
+        return;
+
+    if (current->preempt_count++ == 0)
+        trace_preempt_off();
+    asm volatile ("" ::: "memory");
+}
+
+void preempt_enable(void);
+
+/**
+ * @brief Charges the current thread a jiffy, called from `timer_tick()`
+ */
+void sched_tick(void);
+
+/**
+ * @brief Preempts the current thread if needed, called on interrupt exit
+ */
+void sched_irq_exit(void);
+
+#endif
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/softirq.h
+ *
+ * @brief Deferred interrupt work ("bottom halves")
+ *
+ * Interrupt handlers run with interrupts disabled, so they should only do
+ * what can't wait (talk to the hardware, queue the data) and raise a softirq
+ * for the rest. Pending softirqs run on the way out of the interrupt, after
+ * the EOI, with interrupts enabled again.
+ */
+#ifndef SOFTIRQ_H
+#define SOFTIRQ_H
+
+#include <stdbool.h>
+
+/* Lower numbers run first. */
+enum softirq_nr {
+    SOFTIRQ_TIMER,
+    SOFTIRQ_KEYBOARD,
+
+    NUM_SOFTIRQS,
+};
+
+typedef void (*softirq_handler_f)(void);
+
+/**
+ * @brief Sets the handler to run when softirq `nr` is raised
+ */
+void open_softirq(enum softirq_nr nr, softirq_handler_f handler);
+
+/**
+ * @brief Marks softirq `nr` pending
+ *
+ * Safe to call from interrupt handlers. Raising a softirq that is already
+ * pending does nothing, so handlers have to process everything queued, not
+ * just one item.
+ */
+void raise_softirq(enum softirq_nr nr);
+
+/**
+ * @brief Runs all pending softirqs
+ *
+ * Called on interrupt exit with interrupts disabled, returns with interrupts
+ * disabled. Does nothing if it interrupted softirq processing.
+ */
+void do_softirq(void);
+
+/**
+ * @brief Whether any softirq is waiting to run
+ */
+bool softirq_pending(void);
+
+/**
+ * @brief Whether we are running a softirq handler
+ */
+bool in_softirq(void);
+
+#endif
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/spinlock.h
+ *
+ * @brief Ticket spinlocks and reader-writer locks, with statistics
+ *
+ * Both kinds of lock disable interrupts on the local CPU while held, so they
+ * can be shared with interrupt handlers, and holders can't be preempted
+ * (which could leave another thread spinning on the same CPU). Don't sleep
+ * while holding one.
+ *
+ * Every lock counts its acquisitions, how many had to wait, and the longest
+ * it was held (in TSC cycles). Locks show up in the lock statistics once first
+ * taken.
+ */
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <irqflags.h>
+
+struct lock_stats {
+    const char *name;
+    struct lock_stats *next;
+    volatile uint32_t registered;
+
+    /* Exclusive acquisitions, updated while holding the lock */
+    uint32_t acquired;
+    uint32_t contended;
+    uint64_t wait_cycles;
+    uint64_t max_hold_cycles;
+
+    /* Shared acquisitions (read locks), updated atomically */
+    volatile uint32_t read_acquired;
+    volatile uint32_t read_contended;
+};
+
+struct spinlock {
+    /* Take a ticket, wait until it's served. */
+    volatile uint32_t next;
+    volatile uint32_t serving;
+
+    uint64_t hold_start;
+    struct lock_stats stats;
+};
+
+#define SPINLOCK_INIT(lock_name) { .stats = { .name = (lock_name) } }
+
+/*
+ * Any number of readers, or one writer. Readers can starve writers, so use it
+ * where writes are rare.
+ */
+struct rwlock {
+    /* Number of readers, or RWLOCK_WRITER */
+    volatile uint32_t count;
+
+    uint64_t hold_start;
+    struct lock_stats stats;
+};
+
+#define RWLOCK_WRITER 0x80000000
+
+#define RWLOCK_INIT(lock_name) { .stats = { .name = (lock_name) } }
+
+void spin_lock_init(struct spinlock *lock, const char *name);
+
+irqflags_t spin_lock_irqsave(struct spinlock *lock);
+void spin_unlock_irqrestore(struct spinlock *lock, irqflags_t flags);
+
+/**
+ * @brief Takes `lock` if that doesn't mean waiting
+ *
+ * @return Whether it did (and disabled interrupts, to restore with `*flags`)
+ */
+bool spin_trylock_irqsave(struct spinlock *lock, irqflags_t *flags);
+
+void rwlock_init(struct rwlock *lock, const char *name);
+
+irqflags_t read_lock_irqsave(struct rwlock *lock);
+void read_unlock_irqrestore(struct rwlock *lock, irqflags_t flags);
+
+irqflags_t write_lock_irqsave(struct rwlock *lock);
+void write_unlock_irqrestore(struct rwlock *lock, irqflags_t flags);
+
+#endif
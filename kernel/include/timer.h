@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/timer.h
+ *
+ * @brief Kernel timers
+ *
+ * Time is counted in jiffies, ticks of the periodic timer interrupt. Timer
+ * callbacks run in softirq context, with interrupts enabled. Timers can be
+ * started and stopped on any CPU.
+ *
+ * Pending timers are kept in a hierarchical timing wheel: starting, stopping
+ * and restarting a timer is O(1), no matter how many are pending. Timers far
+ * in the future sit in coarse slots and move to finer ones as they come
+ * closer.
+ */
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Timer interrupts per second. */
+#define HZ 1000
+
+/* Ticks since the timer interrupt was started. Wraps around after about 49
+ * days, so compare with `time_after()`/`time_before()`. */
+extern volatile uint32_t jiffies;
+
+#define time_after(a, b) ((int32_t)((b) - (a)) < 0)
+#define time_before(a, b) time_after(b, a)
+#define time_after_eq(a, b) ((int32_t)((a) - (b)) >= 0)
+
+#define msecs_to_jiffies(ms) (((uint32_t)(ms) * HZ + 999) / 1000)
+
+typedef void (*timer_f)(void *data);
+
+struct timer {
+    /* Wheel slot list. `pprev` is NULL if the timer isn't pending. */
+    struct timer *next;
+    struct timer **pprev;
+
+    uint32_t expires;
+
+    timer_f fn;
+    void *data;
+};
+
+static inline void timer_setup(struct timer *t, timer_f fn, void *data)
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->fn = fn;
+    t->data = data;
+}
+
+static inline bool timer_pending(const struct timer *t)
+{
+    return t->pprev != NULL;
+}
+
+/**
+ * @brief Starts a timer, or restarts it if it is pending
+ *
+ * `t->fn` is called with `t->data` once `jiffies` reaches `expires`.
+ */
+void mod_timer(struct timer *t, uint32_t expires);
+
+/**
+ * @brief Stops a timer
+ *
+ * @return Whether the timer was pending
+ */
+bool del_timer(struct timer *t);
+
+/*
+ * Hardware behind the tick, provided by the architecture. Normally it
+ * interrupts every jiffy, but while idle it can be set to fire only once,
+ * after `ticks` jiffies, so the CPU can sleep through the ticks in between.
+ */
+struct tick_device {
+    const char *name;
+    void (*periodic)(void);
+    void (*oneshot)(uint32_t ticks);
+    uint32_t max_ticks; /* longest one-shot */
+};
+
+/**
+ * @brief Sets the device whose interrupt calls `timer_tick()`
+ */
+void tick_set_device(const struct tick_device *dev);
+
+/**
+ * @brief Stops the periodic tick until the next timer is due
+ *
+ * Called by the idle loop with interrupts disabled. Does nothing if a timer is
+ * due on the next tick anyway, or if there is no clocksource to tell how long
+ * we slept.
+ *
+ * @return Whether the tick was stopped
+ */
+bool tick_nohz_stop(void);
+
+/**
+ * @brief Restarts the periodic tick and accounts for the jiffies slept through
+ *
+ * Called on every interrupt (with interrupts disabled), does nothing unless
+ * the tick was stopped.
+ */
+void tick_nohz_restart(void);
+
+/**
+ * @brief Jiffies skipped by stopping the tick so far
+ */
+uint64_t tick_nohz_skipped(void);
+
+/**
+ * @brief Sets up timer processing, call before starting the timer interrupt
+ */
+void timer_init(void);
+
+/**
+ * @brief Advances `jiffies` by one, called by the timer interrupt handler
+ */
+void timer_tick(void);
+
+#endif
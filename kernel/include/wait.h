@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/wait.h
+ *
+ * @brief Sleeping until something happens
+ *
+ * Threads waiting for a condition (e.g. input arriving) sleep on a wait
+ * queue. Whoever makes the condition true (often an interrupt handler) calls
+ * `wake_up()` on it, and the waiters check the condition again.
+ */
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <irqflags.h>
+
+#include "sched.h"
+#include "timer.h"
+
+#define WAIT_FOREVER UINT32_MAX
+
+struct waiter {
+    struct thread *thread;
+    struct waiter *next, **pprev;
+};
+
+struct wait_queue {
+    struct waiter *head;
+};
+
+#define WAIT_QUEUE_INIT { NULL }
+
+/**
+ * @brief Adds the current thread to `wq` and marks it sleeping
+ *
+ * Call with interrupts disabled, then `schedule()`, then `finish_wait()`.
+ */
+void prepare_to_wait(struct wait_queue *wq, struct waiter *w);
+
+/**
+ * @brief Removes the current thread from the wait queue again
+ */
+void finish_wait(struct waiter *w);
+
+/**
+ * @brief Wakes all threads waiting on `wq`
+ *
+ * Safe to call from interrupt handlers.
+ */
+void wake_up(struct wait_queue *wq);
+
+/**
+ * @brief Sleeps on `wq` until `cond` is true, for at most `ms` milliseconds
+ *
+ * `cond` is evaluated with interrupts disabled, so a `wake_up()` from an
+ * interrupt handler can't come between checking it and going to sleep. A
+ * timeout of 0 checks once without sleeping, `WAIT_FOREVER` never times out.
+ *
+ * @return Whether `cond` became true (false if timed out)
+ */
+#define wait_event_timeout(wq, cond, ms) ({ \
+    uint32_t __ms = (ms); \
+    uint32_t __end = jiffies + msecs_to_jiffies(__ms); \
+    bool __done; \
+    irqflags_t __flags = local_irq_save(); \
+    while (!(__done = (cond))) { \
+        int32_t __left = __end - jiffies; \
+        if (__ms != WAIT_FOREVER && __left <= 0) \
+            break; \
+        struct waiter __w; \
+        prepare_to_wait((wq), &__w); \
+        schedule_timeout(__ms == WAIT_FOREVER ? \
+            MAX_SCHEDULE_TIMEOUT : (uint32_t)__left); \
+        finish_wait(&__w); \
+    } \
+    local_irq_restore(__flags); \
+    __done; \
+})
+
+#define wait_event(wq, cond) wait_event_timeout(wq, cond, WAIT_FOREVER)
+
+#endif
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/**
+ * @file kernel/include/workqueue.h
+ *
+ * @brief Background work spread across CPUs
+ *
+ * Work is queued on the CPU that queues it, and run by that CPU's worker. A
+ * worker with nothing to do steals work from other CPUs, so work queued on one
+ * busy CPU ends up spread over all of them.
+ *
+ * Work may run on any CPU, so it must only use code that is safe to run on
+ * several CPUs at once.
+ */
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdbool.h>
+
+/* Work items a CPU can hold, must be a power of two */
+#define WORK_QUEUE_SIZE 1024
+
+struct work {
+    void (*fn)(struct work *);
+};
+
+#define WORK_INIT(f) { .fn = (f) }
+
+/**
+ * @brief Queues `w` to have `w->fn(w)` run later
+ *
+ * Safe to call from interrupt handlers. The same item must not be queued
+ * again before it ran.
+ *
+ * @return false if this CPU's queue is full
+ */
+bool queue_work(struct work *w);
+
+/**
+ * @brief Runs queued (or stolen) work forever, for CPUs without threads
+ *
+ * Halts while there's no work.
+ */
+__attribute__((noreturn)) void work_cpu_loop(void);
+
+/**
+ * @brief Wakes the calling CPU's worker, called by the wakeup IPI handler
+ */
+void work_kick(void);
+
+#endif
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/initcall.c
+ *
+ * Runs the initcalls. Within a level, each gets a thread on the boot CPU, and
+ * the boot thread sleeps until they're all done. The other CPUs can't take
+ * them: registering IRQs, softirqs and threads is only safe on the boot CPU.
+ * So this overlaps initcalls that sleep or wait for interrupts, it doesn't
+ * make the ones that compute any faster.
+ *
+ * Each initcall is timed from when its thread starts to when it returns, so
+ * time its siblings ran in between counts too.
+ * see also: kernel/arch/i686/include/initcall.h
+ */
+
+#include <initcall.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic.h>
+#include <cycles.h>
+#include <irqflags.h>
+
+#include "ktime.h"
+#include "sched.h"
+#include "wait.h"
+
+/* Level boundaries, from the linker script */
+extern struct initcall __initcall_start[], __initcall_core[],
+    __initcall_device[], __initcall_late[], __initcall_end[];
+
+static struct {
+    const char *name;
+    struct initcall *start, *end;
+    uint64_t cycles;
+} levels[] = {
+    { "early", __initcall_start, __initcall_core, 0 },
+    { "core", __initcall_core, __initcall_device, 0 },
+    { "device", __initcall_device, __initcall_late, 0 },
+    { "late", __initcall_late, __initcall_end, 0 },
+};
+
+#define NUM_LEVELS (sizeof(levels) / sizeof(levels[0]))
+
+static volatile uint32_t running;
+static struct wait_queue done_wait = WAIT_QUEUE_INIT;
+
+static void run(struct initcall *ic)
+{
+    uint64_t start = get_cycles();
+    ic->fn();
+    ic->cycles = get_cycles() - start;
+}
+
+static void initcall_thread(void *arg)
+{
+    run(arg);
+
+    atomic_fetch_add(&running, -1);
+    wake_up(&done_wait);
+}
+
+static void run_level(struct initcall *start, struct initcall *end)
+{
+    for (struct initcall *ic = start; ic < end; ic++) {
+        atomic_fetch_add(&running, 1);
+        if (!thread_create(ic->name, PRIO_DEFAULT, initcall_thread, ic)) {
+            atomic_fetch_add(&running, -1);
+            run(ic);
+        }
+    }
+
+    wait_event(&done_wait, running == 0);
+}
+
+static void print_cycles(const char *what, const char *kind, uint64_t cycles)
+{
+    uint64_t us = cycles_to_ns(cycles) / NSEC_PER_USEC;
+    printf("info: initcall: %12llu cycles %8llu us  %s%s\n", cycles, us,
+        what, kind);
+}
+
+/* Slowest first */
+static void print_report(void)
+{
+    size_t n = __initcall_end - __initcall_start;
+    struct initcall **sorted = malloc(n * sizeof(*sorted));
+    if (!sorted)
+        return;
+
+    for (size_t i = 0; i < n; i++) {
+        struct initcall *ic = &__initcall_start[i];
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1]->cycles < ic->cycles; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = ic;
+    }
+
+    printf("info: initcall: boot report, slowest first\n");
+    for (size_t i = 0; i < n; i++)
+        print_cycles(sorted[i]->name, "", sorted[i]->cycles);
+
+    uint64_t total = 0;
+    for (size_t l = 0; l < NUM_LEVELS; l++) {
+        print_cycles(levels[l].name, " level", levels[l].cycles);
+        total += levels[l].cycles;
+    }
+    print_cycles("all levels", "", total);
+
+    free(sorted);
+}
+
+void do_initcalls()
+{
+    for (size_t l = 0; l < NUM_LEVELS; l++) {
+        uint64_t start = get_cycles();
+        run_level(levels[l].start, levels[l].end);
+        levels[l].cycles = get_cycles() - start;
+    }
+
+    print_report();
+}
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include "irq.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cycles.h>
+#include <initcall.h>
+#include <irqflags.h>
+#include <percpu.h>
+#include <drivers/procinfo.h>
+
+#include "rcu.h"
+#include "timer.h"
+
+/* Report a line nobody handles after this many interrupts, it is probably
+ * stuck. */
+#define UNHANDLED_REPORT 1000
+
+static const struct irq_chip *chip;
+
+static struct irq_desc descs[NR_IRQS];
+
+void irq_set_chip(const struct irq_chip *new_chip)
+{
+    chip = new_chip;
+}
+
+const char *irq_chip_name()
+{
+    return chip ? chip->name : "none";
+}
+
+const struct irq_desc *irq_to_desc(unsigned irq)
+{
+    return irq < NR_IRQS ? &descs[irq] : NULL;
+}
+
+int request_irq(unsigned irq, irq_handler_f handler, void *data)
+{
+    if (!chip || irq >= chip->nr_irqs || !handler)
+        return -EINVAL;
+
+    struct irq_action *action = malloc(sizeof(*action));
+    if (!action)
+        return -ENOMEM;
+
+    action->next = NULL;
+    action->handler = handler;
+    action->data = data;
+
+    struct irq_desc *desc = &descs[irq];
+
+    irqflags_t flags = local_irq_save();
+
+    struct irq_action **pp = &desc->actions;
+    while (*pp)
+        pp = &(*pp)->next;
+    *pp = action;
+
+    if (desc->actions == action)
+        chip->unmask(irq);
+
+    local_irq_restore(flags);
+    return 0;
+}
+
+void free_irq(unsigned irq, void *data)
+{
+    if (irq >= NR_IRQS)
+        return;
+
+    struct irq_desc *desc = &descs[irq];
+    struct irq_action *action = NULL;
+
+    irqflags_t flags = local_irq_save();
+
+    for (struct irq_action **pp = &desc->actions; *pp; pp = &(*pp)->next) {
+        if ((*pp)->data == data) {
+            action = *pp;
+            *pp = action->next;
+            break;
+        }
+    }
+
+    if (!desc->actions)
+        chip->mask(irq);
+
+    local_irq_restore(flags);
+
+    if (action)
+        free(action);
+}
+
+static void account(struct irq_desc *desc, uint64_t cycles)
+{
+    uint32_t c = cycles > UINT32_MAX ? UINT32_MAX : cycles;
+    unsigned bucket = c ? 31 - __builtin_clz(c) : 0;
+
+    desc->cycles += c;
+    desc->hist[bucket]++;
+    if (c > desc->max_cycles)
+        desc->max_cycles = c;
+}
+
+void handle_irq(unsigned irq, struct registers *regs)
+{
+    struct irq_desc *desc = &descs[irq];
+
+    if (chip->spurious && chip->spurious(irq)) {
+        desc->spurious++;
+        return;
+    }
+
+    uint64_t start = get_cycles();
+    struct registers *old_regs = set_irq_regs(regs);
+    bool handled = false;
+
+    desc->count++;
+
+    /* Handlers may be RCU readers, even if we interrupted the idle loop. */
+    rcu_irq_enter();
+
+    /* Catch up on the jiffies slept through first, handlers may use them. */
+    tick_nohz_restart();
+
+    for (struct irq_action *a = desc->actions; a; a = a->next) {
+        if (a->handler(irq, a->data) == IRQ_HANDLED)
+            handled = true;
+    }
+
+    if (!handled && ++desc->unhandled == UNHANDLED_REPORT)
+        printf("warn: irq: nobody handled IRQ %u %u times\n",
+            irq, UNHANDLED_REPORT);
+
+    chip->eoi(irq);
+
+    account(desc, get_cycles() - start);
+    set_irq_regs(old_regs);
+}
+
+static void show_interrupts(struct seqbuf *s)
+{
+    seq_printf(s, "chip: %s\n\n", irq_chip_name());
+    seq_printf(s, "IRQ vector        count  unhandled  spurious  avg cycles"
+        "  max cycles\n");
+
+    static struct irq_desc snap[NR_IRQS];
+
+    /* Consistent numbers for both tables. */
+    irqflags_t flags = local_irq_save();
+    memcpy(snap, descs, sizeof(snap));
+    local_irq_restore(flags);
+
+    for (unsigned irq = 0; irq < NR_IRQS; irq++) {
+        const struct irq_desc *desc = &snap[irq];
+        if (!desc->count && !desc->spurious && !desc->actions)
+            continue;
+
+        uint64_t avg = desc->count ? desc->cycles / desc->count : 0;
+        seq_printf(s, "%3u   0x%02x %12llu %10u %9u %11llu %11u\n", irq,
+            chip->vector_base + irq, desc->count, desc->unhandled,
+            desc->spurious, avg, desc->max_cycles);
+    }
+
+    seq_printf(s, "\nHandler cycles, log2 buckets (2^n: count):\n");
+
+    for (unsigned irq = 0; irq < NR_IRQS; irq++) {
+        const struct irq_desc *desc = &snap[irq];
+        if (!desc->count)
+            continue;
+
+        seq_printf(s, "%3u:", irq);
+        for (unsigned b = 0; b < IRQ_HIST_BUCKETS; b++) {
+            if (desc->hist[b])
+                seq_printf(s, " 2^%u:%u", b, desc->hist[b]);
+        }
+        seq_printf(s, "\n");
+    }
+}
+
+void irq_procinfo_setup()
+{
+    register_procinfo(PROCINFO_INTERRUPTS, show_interrupts);
+}
+
+core_initcall(irq_procinfo_setup);
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/irqsoff.c
+ *
+ * Interrupts-off and preemption-off latency tracer. A window is open from the
+ * first hook that disables to the hook that enables again, so nested
+ * `local_irq_save()`s (which don't change anything) don't count twice.
+ *
+ * Interrupts-off windows don't nest and only the CPU itself touches its own
+ * state, with interrupts off, so that needs no locks. The preemption-off state
+ * is the boot CPU's, where an interrupt handler taking an RCU read lock right
+ * as the thread reenables preemption may close the thread's window early. The
+ * times are off by a few cycles then, not worth disabling interrupts for.
+ *
+ * The hooks are excluded from the function tracer: its own hook disables
+ * interrupts.
+ * see also: kernel/include/irqsoff.h
+ */
+
+#include "irqsoff.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bench.h>
+#include <cycles.h>
+#include <initcall.h>
+#include <irqflags.h>
+#include <percpu.h>
+#include <drivers/procinfo.h>
+
+#define NO_TRACE __attribute__((no_instrument_function))
+
+/* Bucket `n` counts windows of 2^n to 2^(n+1)-1 cycles. */
+#define LATENCY_HIST_BUCKETS 32
+
+struct latency {
+    uint64_t start; /* 0 while no window is open */
+    void *start_site;
+
+    uint32_t windows;
+    uint64_t max_cycles;
+    void *max_start, *max_end;
+    uint32_t hist[LATENCY_HIST_BUCKETS];
+};
+
+struct irqsoff_cpu {
+    struct latency irqs;
+} __attribute__((aligned(64)));
+
+static struct irqsoff_cpu irqsoff_cpus[NR_CPUS];
+static struct latency preempt;
+
+static volatile bool enabled;
+
+static inline NO_TRACE void window_start(struct latency *l, void *site)
+{
+    if (l->start)
+        return;
+
+    l->start_site = site;
+    l->start = get_cycles();
+}
+
+static inline NO_TRACE void window_end(struct latency *l, void *site)
+{
+    if (!l->start)
+        return;
+
+    uint64_t cycles = get_cycles() - l->start;
+    l->start = 0;
+
+    uint32_t c = cycles > UINT32_MAX ? UINT32_MAX : cycles;
+    l->hist[c ? 31 - __builtin_clz(c) : 0]++;
+    l->windows++;
+
+    if (cycles > l->max_cycles) {
+        l->max_cycles = cycles;
+        l->max_start = l->start_site;
+        l->max_end = site;
+    }
+}
+
+NO_TRACE void trace_hardirqs_off()
+{
+    if (enabled)
+        window_start(&irqsoff_cpus[smp_processor_id()].irqs,
+            __builtin_return_address(0));
+}
+
+NO_TRACE void trace_hardirqs_on()
+{
+    if (enabled)
+        window_end(&irqsoff_cpus[smp_processor_id()].irqs,
+            __builtin_return_address(0));
+}
+
+NO_TRACE void trace_preempt_off()
+{
+    if (enabled)
+        window_start(&preempt, __builtin_return_address(0));
+}
+
+NO_TRACE void trace_preempt_on(void *site)
+{
+    if (enabled)
+        window_end(&preempt, site);
+}
+
+static void show_latency(struct seqbuf *s, const char *what, unsigned cpu,
+        const struct latency *l)
+{
+    seq_printf(s, "%-8s %3u %10u %12llu   %08x %08x\n", what, cpu, l->windows,
+        l->max_cycles, (uint32_t)l->max_start, (uint32_t)l->max_end);
+}
+
+static void show_hist(struct seqbuf *s, const char *what, unsigned cpu,
+        const struct latency *l)
+{
+    seq_printf(s, "%-8s %3u:", what, cpu);
+    for (unsigned b = 0; b < LATENCY_HIST_BUCKETS; b++) {
+        if (l->hist[b])
+            seq_printf(s, " 2^%u:%u", b, l->hist[b]);
+    }
+    seq_printf(s, "\n");
+}
+
+static void show_irqsoff(struct seqbuf *s)
+{
+    static struct latency snap[NR_CPUS + 1];
+    unsigned n = num_online_cpus();
+
+    /* Only ours is consistent, the others keep changing meanwhile. */
+    irqflags_t flags = local_irq_save();
+    for (unsigned cpu = 0; cpu < n; cpu++)
+        snap[cpu] = irqsoff_cpus[cpu].irqs;
+    snap[n] = preempt;
+    local_irq_restore(flags);
+
+    seq_printf(s, "%-8s %3s %10s %12s   %-8s %-8s\n", "window", "cpu",
+        "count", "max cycles", "from", "to");
+    for (unsigned cpu = 0; cpu < n; cpu++)
+        show_latency(s, "irqsoff", cpu, &snap[cpu]);
+    show_latency(s, "preempt", 0, &snap[n]);
+
+    seq_printf(s, "\nWindow cycles, log2 buckets (2^n: count):\n");
+    for (unsigned cpu = 0; cpu < n; cpu++)
+        show_hist(s, "irqsoff", cpu, &snap[cpu]);
+    show_hist(s, "preempt", 0, &snap[n]);
+}
+
+/* What the tracer adds to every critical section */
+static void bench_irqsave(uint32_t iters)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        irqflags_t flags = local_irq_save();
+        local_irq_restore(flags);
+    }
+}
+
+BENCHMARK(irqsave, bench_irqsave);
+
+void irqsoff_bench_report()
+{
+    uint64_t irqs_max = 0;
+
+    irqflags_t flags = local_irq_save();
+    for (unsigned cpu = 0; cpu < num_online_cpus(); cpu++) {
+        if (irqsoff_cpus[cpu].irqs.max_cycles > irqs_max)
+            irqs_max = irqsoff_cpus[cpu].irqs.max_cycles;
+    }
+    uint64_t preempt_max = preempt.max_cycles;
+    local_irq_restore(flags);
+
+    bench_report("irqsoff.max", irqs_max, "cycles", BENCH_LOWER_IS_BETTER);
+    bench_report("irqsoff.preempt_max", preempt_max, "cycles",
+        BENCH_LOWER_IS_BETTER);
+}
+
+void irqsoff_init()
+{
+    /* Every CPU is up and has %gs set by now. */
+    enabled = true;
+
+    register_procinfo(PROCINFO_LATENCY, show_irqsoff);
+}
+
+early_initcall(irqsoff_init);
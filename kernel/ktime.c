@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include "ktime.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <irqflags.h>
+
+#include "timer.h"
+
+static uint64_t jiffies_read()
+{
+    return jiffies;
+}
+
+static struct clocksource jiffies_clocksource = {
+    .name = "jiffies",
+    .rating = 1,
+    .read = jiffies_read,
+    .freq = HZ,
+    .mult = NSEC_PER_SEC / HZ,
+    .shift = 0,
+};
+
+const struct clocksource *clocksource = &jiffies_clocksource;
+
+/* The CPU cycle counter, if registered. */
+static const struct clocksource *cycles_clocksource;
+
+uint64_t cycles_to_ns(uint64_t cycles)
+{
+    if (!cycles_clocksource)
+        return 0;
+    return clocksource_cyc2ns(cycles_clocksource, cycles);
+}
+
+uint64_t cycles_freq()
+{
+    return cycles_clocksource ? cycles_clocksource->freq : 0;
+}
+
+/* Largest `shift` (up to 32) for which `mult` still fits in 32 bits. */
+static void calc_mult_shift(struct clocksource *cs)
+{
+    for (uint32_t shift = 32; ; shift--) {
+        uint64_t mult = (NSEC_PER_SEC << shift) / cs->freq;
+        if (mult <= UINT32_MAX || shift == 0) {
+            cs->mult = mult;
+            cs->shift = shift;
+            return;
+        }
+    }
+}
+
+void clocksource_register(struct clocksource *cs)
+{
+    calc_mult_shift(cs);
+
+    if (!cs->read)
+        cycles_clocksource = cs;
+
+    if (cs->rating <= clocksource->rating)
+        return;
+
+    irqflags_t flags = local_irq_save();
+
+    uint64_t now = ktime_get_ns();
+    cs->offset_ns = now - clocksource_cyc2ns(cs, clocksource_read(cs));
+    clocksource = cs;
+
+    local_irq_restore(flags);
+
+    printf("info: ktime: using clocksource %s\n", cs->name);
+}
@@ -5,6 +5,10 @@
 
 #include <stdio.h>
 
+#include <stacktrace.h>
+
+#define PANIC_TRACE_DEPTH 32
+
 extern void halt_loop(void);
 
 void panic(const char *format, ...)
@@ -16,15 +20,15 @@ void panic(const char *format, ...)
     
     va_end(args);
 
-    void *unwind_ptr;
-    while (panic_unwind(&unwind_ptr))
-        printf("\tat %p\n", unwind_ptr);
+    void *trace[PANIC_TRACE_DEPTH];
+    int n = panic_unwind(trace, PANIC_TRACE_DEPTH);
+    for (int i = 0; i < n; i++)
+        printf("\tat %p\n", trace[i]);
 
     halt_loop();
 }
 
-int panic_unwind(void **unwind_ptr)
+int panic_unwind(void **entries, int max)
 {
-    /* TODO */
-    return 0;
+    return stack_trace(entries, max > 0 ? max : 0);
 }
@@ -0,0 +1,204 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/profile.c
+ *
+ * Sampling profiler. Each CPU only ever writes samples into its own ring, from
+ * interrupt context, and the profile device is the only reader, so the rings
+ * need no locks on the sampling side.
+ * see also: kernel/include/profile.h
+ */
+
+#include "profile.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic.h>
+#include <initcall.h>
+#include <percpu.h>
+#include <stacktrace.h>
+#include <drivers/driver.h>
+#include <drivers/major.h>
+
+#include "ring.h"
+#include "spinlock.h"
+
+/* "<cpu> " plus " <address>" per entry, and the newline */
+#define SAMPLE_LINE_LEN (4 + PROFILE_DEPTH * 9 + 2)
+
+/* Samples taken out of the rings per read, kept on the stack */
+#define READ_BATCH 8
+
+struct profile_sample {
+    uint16_t cpu;
+    uint16_t depth;
+    void *entries[PROFILE_DEPTH];
+};
+
+typedef RING(struct profile_sample, PROFILE_RING_SIZE) sample_ring;
+
+/* Allocated on the first start, kept afterwards */
+static sample_ring *rings[NR_CPUS];
+
+static volatile bool profiling;
+static volatile uint32_t dropped;
+
+/* Keeps readers one consumer per ring */
+static struct spinlock read_lock = SPINLOCK_INIT("profile_read");
+
+bool profile_start()
+{
+    for (unsigned cpu = 0; cpu < num_online_cpus(); cpu++) {
+        if (rings[cpu])
+            continue;
+
+        sample_ring *r = malloc(sizeof(*r));
+        if (!r)
+            return false;
+        r->head = r->tail = 0;
+        rings[cpu] = r;
+    }
+
+    dropped = 0;
+    smp_store_release(&profiling, true);
+    printf("info: profile: sampling every tick on %u CPU(s)\n",
+        num_online_cpus());
+    return true;
+}
+
+void profile_stop()
+{
+    profiling = false;
+    if (dropped)
+        printf("warn: profile: %u sample(s) dropped, buffers full\n", dropped);
+}
+
+bool profile_enabled()
+{
+    return profiling;
+}
+
+void profile_sample(struct registers *regs)
+{
+    unsigned cpu = smp_processor_id();
+    sample_ring *r = rings[cpu];
+
+    if (!profiling || !r)
+        return;
+
+    /* Only we push to this ring, so a free slot stays free. */
+    if (ring_full(r)) {
+        atomic_fetch_add(&dropped, 1);
+        return;
+    }
+
+    struct profile_sample *s = ring_slot(r, r->head);
+    s->cpu = cpu;
+    s->depth = stack_trace_regs(regs, s->entries, PROFILE_DEPTH);
+    smp_store_release(&r->head, r->head + 1);
+}
+
+void profile_tick()
+{
+    if (!profiling)
+        return;
+
+    struct registers *regs = get_irq_regs();
+    if (regs)
+        profile_sample(regs);
+
+    for (unsigned cpu = 1; cpu < num_online_cpus(); cpu++)
+        smp_send_profile(cpu);
+}
+
+static size_t format_sample(const struct profile_sample *s, char *line)
+{
+    size_t len = snprintf(line, SAMPLE_LINE_LEN, "%u", s->cpu);
+    for (unsigned i = 0; i < s->depth; i++)
+        len += snprintf(&line[len], SAMPLE_LINE_LEN - len, " %08x",
+            (uint32_t)s->entries[i]);
+    line[len++] = '\n';
+    return len;
+}
+
+/*
+ * Takes as many samples out of the rings as surely fit into `buf` as lines,
+ * and formats them there. Only copying them out needs the lock, formatting
+ * happens with interrupts enabled. A buffer that can't take the longest
+ * possible line is an error, not end of file.
+ */
+static int read_samples(char *buf, size_t n)
+{
+    struct profile_sample batch[READ_BATCH];
+    size_t max = n / SAMPLE_LINE_LEN, taken = 0;
+
+    if (max == 0)
+        return -EINVAL;
+    if (max > READ_BATCH)
+        max = READ_BATCH;
+
+    irqflags_t flags = spin_lock_irqsave(&read_lock);
+    for (unsigned cpu = 0; cpu < NR_CPUS && taken < max; cpu++) {
+        sample_ring *r = rings[cpu];
+        if (r)
+            taken += ring_read(r, &batch[taken], max - taken);
+    }
+    spin_unlock_irqrestore(&read_lock, flags);
+
+    size_t count = 0;
+    for (size_t i = 0; i < taken; i++)
+        count += format_sample(&batch[i], &buf[count]);
+    return count;
+}
+
+void profile_dump()
+{
+    char buf[1024];
+    int n;
+
+    printf("profile: begin\n");
+    while ((n = read_samples(buf, sizeof(buf) - 1)) > 0) {
+        buf[n] = '\0';
+        printf("%s", buf);
+    }
+    printf("profile: end\n");
+}
+
+static int profile_read(dev_t dev, off_t pos, char *buf, size_t n)
+{
+    (void)dev;
+    (void)pos;
+    return read_samples(buf, n);
+}
+
+static int profile_write(dev_t dev, off_t pos, const char *buf, size_t n)
+{
+    (void)dev;
+    (void)pos;
+
+    if (n >= 5 && memcmp(buf, "start", 5) == 0)
+        return profile_start() ? (int)n : -ENOMEM;
+    if (n >= 4 && memcmp(buf, "stop", 4) == 0) {
+        profile_stop();
+        return n;
+    }
+    return -EINVAL;
+}
+
+static struct char_driver profile_driver = {
+    .read = profile_read,
+    .write = profile_write,
+};
+
+void profile_init()
+{
+    register_char_driver(CHR_PROFILE, &profile_driver);
+}
+
+core_initcall(profile_init);
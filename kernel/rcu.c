@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/rcu.c
+ *
+ * Quiescent-state-based RCU. A global counter advances by one step per grace
+ * period. Every CPU copies it into its own counter whenever it passes a
+ * quiescent state, and sets its counter to RCU_IDLE while idle. A grace period
+ * started at counter value `gp` is over once every CPU's counter is RCU_IDLE
+ * or has reached `gp`.
+ *
+ * Readers only disable preemption, which on the CPUs without threads costs
+ * nothing at all.
+ * see also: kernel/include/rcu.h
+ */
+
+#include "rcu.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+
+#include <atomic.h>
+#include <barrier.h>
+#include <initcall.h>
+#include <irqflags.h>
+#include <percpu.h>
+#include <drivers/procinfo.h>
+
+#include "sched.h"
+#include "spinlock.h"
+#include "wait.h"
+
+/* Counters step by two from 1, so they never hit RCU_IDLE. */
+#define RCU_IDLE 0
+#define RCU_GP_STEP 2
+
+struct rcu_cpu {
+    volatile uint32_t ctr;
+} __attribute__((aligned(64)));
+
+static volatile uint32_t gp_ctr = 1;
+
+/* The boot CPU starts out reading, the others idle until they're started. */
+static struct rcu_cpu rcu_cpus[NR_CPUS] = { [0] = { .ctr = 1 } };
+
+static struct spinlock cb_lock = SPINLOCK_INIT("rcu_cb");
+static struct rcu_head *volatile cb_head;
+static struct rcu_head **cb_tail = (struct rcu_head **)&cb_head;
+
+static struct wait_queue rcu_wait = WAIT_QUEUE_INIT;
+
+static struct {
+    volatile uint32_t grace_periods;
+    uint32_t callbacks;
+} stats;
+
+void rcu_note_qs()
+{
+    struct rcu_cpu *rc = &rcu_cpus[smp_processor_id()];
+    uint32_t gp = gp_ctr;
+
+    if (rc->ctr == gp)
+        return;
+
+    /* Our reads so far are done before anyone sees the new counter. */
+    smp_mb();
+    rc->ctr = gp;
+    smp_mb();
+}
+
+void rcu_idle_enter()
+{
+    smp_mb();
+    rcu_cpus[smp_processor_id()].ctr = RCU_IDLE;
+}
+
+void rcu_idle_exit()
+{
+    /* Later reads aren't done before the counter is visible again. */
+    rcu_cpus[smp_processor_id()].ctr = gp_ctr;
+    smp_mb();
+}
+
+void rcu_irq_enter()
+{
+    if (rcu_cpus[smp_processor_id()].ctr == RCU_IDLE)
+        rcu_idle_exit();
+}
+
+static bool cpu_passed(unsigned cpu, uint32_t gp)
+{
+    uint32_t ctr = smp_load_acquire(&rcu_cpus[cpu].ctr);
+    return ctr == RCU_IDLE || (int32_t)(ctr - gp) >= 0;
+}
+
+void synchronize_rcu()
+{
+    /* Also a full barrier, ordering the writer's unlinking before. */
+    uint32_t gp = atomic_fetch_add(&gp_ctr, RCU_GP_STEP) + RCU_GP_STEP;
+
+    rcu_note_qs();
+
+    for (unsigned cpu = 0; cpu < num_online_cpus(); cpu++) {
+        while (!cpu_passed(cpu, gp)) {
+            if (smp_processor_id() == 0)
+                msleep(1);
+            else
+                cpu_relax();
+        }
+    }
+
+    smp_mb();
+    atomic_fetch_add(&stats.grace_periods, 1);
+}
+
+void call_rcu(struct rcu_head *head, void (*fn)(struct rcu_head *))
+{
+    head->fn = fn;
+    head->next = NULL;
+
+    irqflags_t flags = spin_lock_irqsave(&cb_lock);
+    *cb_tail = head;
+    cb_tail = &head->next;
+    spin_unlock_irqrestore(&cb_lock, flags);
+
+    /* The callback thread runs on the boot CPU. */
+    if (smp_processor_id() == 0)
+        wake_up(&rcu_wait);
+    else
+        smp_send_wake(0);
+}
+
+void rcu_kick()
+{
+    if (smp_processor_id() == 0 && cb_head)
+        wake_up(&rcu_wait);
+}
+
+static void rcu_thread(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        wait_event(&rcu_wait, cb_head != NULL);
+
+        /* Callbacks queued from now on wait for the next grace period. */
+        irqflags_t flags = spin_lock_irqsave(&cb_lock);
+        struct rcu_head *list = cb_head;
+        cb_head = NULL;
+        cb_tail = (struct rcu_head **)&cb_head;
+        spin_unlock_irqrestore(&cb_lock, flags);
+
+        synchronize_rcu();
+
+        while (list) {
+            struct rcu_head *next = list->next;
+            list->fn(list);
+            list = next;
+            stats.callbacks++;
+        }
+    }
+}
+
+static void show_rcu(struct seqbuf *s)
+{
+    uint32_t gp = gp_ctr;
+
+    seq_printf(s, "grace periods: %u\n", stats.grace_periods);
+    seq_printf(s, "callbacks run: %u\n", stats.callbacks);
+    seq_printf(s, "callbacks pending: %s\n", cb_head ? "yes" : "no");
+
+    seq_printf(s, "\n%4s %s\n", "cpu", "state");
+    for (unsigned cpu = 0; cpu < num_online_cpus(); cpu++) {
+        uint32_t ctr = rcu_cpus[cpu].ctr;
+        if (ctr == RCU_IDLE)
+            seq_printf(s, "%4u idle\n", cpu);
+        else
+            seq_printf(s, "%4u %u grace period(s) behind\n", cpu,
+                (gp - ctr) / RCU_GP_STEP);
+    }
+}
+
+void rcu_init()
+{
+    if (!thread_create("rcu", PRIO_DEFAULT, rcu_thread, NULL))
+        printf("err: rcu: no memory for the callback thread\n");
+
+    register_procinfo(PROCINFO_RCU, show_rcu);
+}
+
+core_initcall(rcu_init);
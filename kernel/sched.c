@@ -0,0 +1,366 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/sched.c
+ *
+ * O(1) scheduler. Runnable threads wait in one FIFO queue per priority, with a
+ * bitmap of the non-empty queues, so picking the next thread is a single
+ * bit scan. The idle thread is on no queue, it runs when the bitmap is empty.
+ * see also: kernel/include/sched.h
+ */
+
+#include "sched.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <initcall.h>
+#include <irqflags.h>
+#include <switch.h>
+#include <drivers/procinfo.h>
+
+#include "idle.h"
+#include "panic.h"
+#include "ktime.h"
+#include "rcu.h"
+#include "softirq.h"
+
+_Static_assert(NR_PRIOS <= 32, "run queue bitmap too small");
+
+static struct {
+    struct thread *head, *tail;
+} run_queue[NR_PRIOS];
+
+/* Bit n set if run_queue[n] is non-empty */
+static uint32_t run_bitmap;
+
+static struct thread boot_thread = {
+    .state = THREAD_RUNNING,
+    .prio = PRIO_DEFAULT,
+    .name = "init",
+};
+
+struct thread *current = &boot_thread;
+
+static struct thread *idle_thread;
+static struct thread *all_threads = &boot_thread;
+static int next_tid = 1;
+
+static bool resched;
+
+static uint64_t last_switch_ns;
+
+/* The thread `switch_stack()` came from, for `finish_switch()` */
+static struct thread *switched_from;
+
+static void enqueue(struct thread *t)
+{
+    t->next = NULL;
+    if (run_queue[t->prio].tail)
+        run_queue[t->prio].tail->next = t;
+    else
+        run_queue[t->prio].head = t;
+    run_queue[t->prio].tail = t;
+    run_bitmap |= 1u << t->prio;
+}
+
+static struct thread *dequeue()
+{
+    if (!run_bitmap)
+        return NULL;
+
+    unsigned prio = __builtin_ctz(run_bitmap);
+    struct thread *t = run_queue[prio].head;
+
+    run_queue[prio].head = t->next;
+    if (!t->next) {
+        run_queue[prio].tail = NULL;
+        run_bitmap &= ~(1u << prio);
+    }
+    return t;
+}
+
+/* A dead thread can't free the stack it's running on, so the next one does. */
+static void reap(struct thread *t)
+{
+    for (struct thread **pp = &all_threads; *pp; pp = &(*pp)->all_next) {
+        if (*pp == t) {
+            *pp = t->all_next;
+            break;
+        }
+    }
+    free(t->stack);
+    free(t);
+}
+
+/* Runs on the new thread's stack right after every switch. */
+static void finish_switch(struct thread *prev)
+{
+    if (prev->state == THREAD_DEAD)
+        reap(prev);
+}
+
+void schedule()
+{
+    irqflags_t flags = local_irq_save();
+    struct thread *prev = current;
+
+    /* Read sections can't sleep, so we're in none. */
+    rcu_note_qs();
+
+    resched = false;
+
+    if (prev == idle_thread) {
+        prev->state = THREAD_READY;
+    } else if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_READY;
+        enqueue(prev);
+    }
+
+    struct thread *next = dequeue();
+    if (!next)
+        next = idle_thread;
+
+    next->state = THREAD_RUNNING;
+    next->slice = msecs_to_jiffies(TIMESLICE_MS);
+
+    if (next != prev) {
+        uint64_t now = ktime_get_ns();
+        prev->runtime_ns += now - last_switch_ns;
+        last_switch_ns = now;
+
+        next->switches++;
+        current = next;
+        switched_from = prev;
+
+        switch_stack(&prev->sp, next->sp);
+
+        /* Back on prev's stack, some time later. */
+        finish_switch(switched_from);
+    }
+
+    local_irq_restore(flags);
+}
+
+/* First thing a new thread runs. */
+static void thread_start()
+{
+    finish_switch(switched_from);
+    local_irq_enable();
+
+    current->fn(current->arg);
+    thread_exit();
+}
+
+static void sleep_timeout(void *data)
+{
+    thread_wake(data);
+}
+
+/* Sets up a thread that isn't running yet (and isn't on the run queue). */
+static struct thread *thread_alloc(const char *name, unsigned prio,
+        void (*fn)(void *), void *arg)
+{
+    struct thread *t = malloc(sizeof(*t));
+    if (!t)
+        return NULL;
+    memset(t, 0, sizeof(*t));
+
+    t->stack = malloc(THREAD_STACK_SIZE);
+    if (!t->stack) {
+        free(t);
+        return NULL;
+    }
+
+    strncpy(t->name, name, THREAD_NAME_LEN - 1);
+    t->prio = prio < NR_PRIOS ? prio : PRIO_LOWEST;
+    t->fn = fn;
+    t->arg = arg;
+    t->sp = stack_init(t->stack + THREAD_STACK_SIZE, thread_start);
+    timer_setup(&t->sleep_timer, sleep_timeout, t);
+
+    t->state = THREAD_READY;
+
+    irqflags_t flags = local_irq_save();
+    t->tid = next_tid++;
+    t->all_next = all_threads;
+    all_threads = t;
+    local_irq_restore(flags);
+
+    return t;
+}
+
+struct thread *thread_create(const char *name, unsigned prio,
+        void (*fn)(void *), void *arg)
+{
+    struct thread *t = thread_alloc(name, prio, fn, arg);
+    if (!t)
+        return NULL;
+
+    t->state = THREAD_SLEEPING;
+    thread_wake(t);
+    return t;
+}
+
+void thread_exit()
+{
+    local_irq_disable();
+    current->state = THREAD_DEAD;
+    schedule();
+
+    /* unreachable */
+    while (1)
+        ;
+}
+
+void thread_wake(struct thread *t)
+{
+    irqflags_t flags = local_irq_save();
+
+    if (t->state == THREAD_SLEEPING) {
+        t->state = THREAD_READY;
+        enqueue(t);
+        if (current == idle_thread || t->prio < current->prio)
+            resched = true;
+    }
+
+    local_irq_restore(flags);
+}
+
+void yield()
+{
+    schedule();
+}
+
+void schedule_timeout(uint32_t ticks)
+{
+    irqflags_t flags = local_irq_save();
+
+    if (ticks != MAX_SCHEDULE_TIMEOUT)
+        mod_timer(&current->sleep_timer, jiffies + ticks);
+    schedule();
+    del_timer(&current->sleep_timer);
+
+    local_irq_restore(flags);
+}
+
+void msleep(uint32_t ms)
+{
+    irqflags_t flags = local_irq_save();
+
+    /* The current jiffy is partly over already. */
+    current->state = THREAD_SLEEPING;
+    schedule_timeout(msecs_to_jiffies(ms) + 1);
+
+    local_irq_restore(flags);
+}
+
+bool need_resched()
+{
+    return resched;
+}
+
+void preempt_enable()
+{
+    if (smp_processor_id() != 0)
+        return;
+
+    asm volatile ("" ::: "memory");
+    if (--current->preempt_count)
+        return;
+
+    trace_preempt_on(__builtin_return_address(0));
+    if (resched && !irqs_disabled() && !in_softirq())
+        schedule();
+}
+
+void sched_tick()
+{
+    /* Interrupted with preemption enabled: not in a read section. */
+    if (!current->preempt_count && !in_softirq())
+        rcu_note_qs();
+
+    if (current == idle_thread || !current->slice)
+        return;
+
+    if (--current->slice == 0 && run_bitmap)
+        resched = true;
+}
+
+void sched_irq_exit()
+{
+    /* The idle thread checks for itself once it's out of `hlt`, so its idle
+     * time doesn't include other threads running. */
+    if (!resched || current->preempt_count || in_softirq() ||
+            current == idle_thread)
+        return;
+
+    schedule();
+}
+
+static void idle_loop(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        local_irq_disable();
+        if (resched) {
+            local_irq_enable();
+            schedule();
+        } else {
+            cpu_idle();
+        }
+    }
+}
+
+void sched_init()
+{
+    last_switch_ns = ktime_get_ns();
+    boot_thread.slice = msecs_to_jiffies(TIMESLICE_MS);
+
+    /* Not on the run queue, it runs only when nothing else does. */
+    idle_thread = thread_alloc("idle", PRIO_LOWEST, idle_loop, NULL);
+    if (!idle_thread)
+        panic("sched: no memory for the idle thread");
+}
+
+static const char *const state_names[] = {
+    [THREAD_RUNNING] = "running",
+    [THREAD_READY] = "ready",
+    [THREAD_SLEEPING] = "sleeping",
+    [THREAD_DEAD] = "dead",
+};
+
+static void show_threads(struct seqbuf *s)
+{
+    seq_printf(s, "%5s %-15s %4s %-8s %10s %10s\n",
+        "tid", "name", "prio", "state", "switches", "runtime");
+
+    irqflags_t flags = local_irq_save();
+
+    /* Includes the time the current thread ran so far. */
+    uint64_t now = ktime_get_ns();
+
+    for (struct thread *t = all_threads; t; t = t->all_next) {
+        uint64_t ns = t->runtime_ns;
+        if (t == current)
+            ns += now - last_switch_ns;
+
+        seq_printf(s, "%5d %-15s %4u %-8s %10llu %7llu ms\n",
+            t->tid, t->name, t->prio, state_names[t->state], t->switches,
+            ns / NSEC_PER_MSEC);
+    }
+
+    local_irq_restore(flags);
+}
+
+void sched_procinfo_setup()
+{
+    register_procinfo(PROCINFO_THREADS, show_threads);
+}
+
+core_initcall(sched_procinfo_setup);
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include "softirq.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <irqflags.h>
+
+/* Stop after this many rounds even if more softirqs got raised meanwhile.
+ * They stay pending for the next interrupt. */
+#define MAX_RESTART 10
+
+static softirq_handler_f handlers[NUM_SOFTIRQS];
+
+static volatile uint32_t pending;
+static bool running;
+
+void open_softirq(enum softirq_nr nr, softirq_handler_f handler)
+{
+    handlers[nr] = handler;
+}
+
+void raise_softirq(enum softirq_nr nr)
+{
+    irqflags_t flags = local_irq_save();
+    pending |= 1 << nr;
+    local_irq_restore(flags);
+}
+
+bool softirq_pending()
+{
+    return pending != 0;
+}
+
+bool in_softirq()
+{
+    return running;
+}
+
+void do_softirq()
+{
+    if (running || !pending)
+        return;
+
+    running = true;
+
+    for (int restart = 0; restart < MAX_RESTART && pending; restart++) {
+        uint32_t todo = pending;
+        pending = 0;
+
+        local_irq_enable();
+
+        for (int nr = 0; nr < NUM_SOFTIRQS; nr++) {
+            if ((todo & (1 << nr)) && handlers[nr])
+                handlers[nr]();
+        }
+
+        local_irq_disable();
+    }
+
+    running = false;
+}
@@ -0,0 +1,208 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/spinlock.c
+ *
+ * Ticket spinlocks: every locker atomically takes the next ticket number and
+ * waits until `serving` reaches it, so the lock is handed out in FIFO order
+ * (unlike a plain test-and-set lock, where the CPU that happens to win the
+ * cache line race gets it).
+ * see also: kernel/include/spinlock.h
+ */
+
+#include "spinlock.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string.h>
+
+#include <atomic.h>
+#include <barrier.h>
+#include <bench.h>
+#include <cycles.h>
+#include <initcall.h>
+#include <irqflags.h>
+#include <drivers/procinfo.h>
+
+/* Every lock taken so far, newest first */
+static struct lock_stats *volatile all_stats;
+
+static void stats_register(struct lock_stats *s)
+{
+    if (s->registered || !cmpxchg(&s->registered, 0, 1))
+        return;
+
+    /* Lock-free push, this can't very well take a lock. */
+    do {
+        s->next = all_stats;
+    } while (!cmpxchg((volatile uint32_t *)&all_stats, (uint32_t)s->next,
+        (uint32_t)s));
+}
+
+/* Called holding the lock */
+static void stats_acquired(struct lock_stats *s, uint64_t wait_start,
+        uint64_t now)
+{
+    stats_register(s);
+
+    s->acquired++;
+    if (wait_start) {
+        s->contended++;
+        s->wait_cycles += now - wait_start;
+    }
+}
+
+/* Called holding the lock */
+static void stats_released(struct lock_stats *s, uint64_t hold_start)
+{
+    uint64_t held = get_cycles() - hold_start;
+    if (held > s->max_hold_cycles)
+        s->max_hold_cycles = held;
+}
+
+void spin_lock_init(struct spinlock *lock, const char *name)
+{
+    memset(lock, 0, sizeof(*lock));
+    lock->stats.name = name;
+}
+
+irqflags_t spin_lock_irqsave(struct spinlock *lock)
+{
+    irqflags_t flags = local_irq_save();
+    uint32_t ticket = atomic_fetch_add(&lock->next, 1);
+    uint64_t wait_start = 0;
+
+    if (smp_load_acquire(&lock->serving) != ticket) {
+        wait_start = get_cycles();
+        while (smp_load_acquire(&lock->serving) != ticket)
+            cpu_relax();
+    }
+
+    lock->hold_start = get_cycles();
+    stats_acquired(&lock->stats, wait_start, lock->hold_start);
+    return flags;
+}
+
+bool spin_trylock_irqsave(struct spinlock *lock, irqflags_t *flags)
+{
+    *flags = local_irq_save();
+
+    /* Free if nobody holds a ticket past the one being served. */
+    uint32_t serving = smp_load_acquire(&lock->serving);
+    if (lock->next != serving || !cmpxchg(&lock->next, serving, serving + 1)) {
+        local_irq_restore(*flags);
+        return false;
+    }
+
+    lock->hold_start = get_cycles();
+    stats_acquired(&lock->stats, 0, lock->hold_start);
+    return true;
+}
+
+void spin_unlock_irqrestore(struct spinlock *lock, irqflags_t flags)
+{
+    stats_released(&lock->stats, lock->hold_start);
+
+    smp_store_release(&lock->serving, lock->serving + 1);
+    local_irq_restore(flags);
+}
+
+void rwlock_init(struct rwlock *lock, const char *name)
+{
+    memset(lock, 0, sizeof(*lock));
+    lock->stats.name = name;
+}
+
+irqflags_t read_lock_irqsave(struct rwlock *lock)
+{
+    irqflags_t flags = local_irq_save();
+    bool waited = false;
+
+    while (1) {
+        uint32_t count = lock->count;
+        if (!(count & RWLOCK_WRITER)) {
+            /* Failing only means another reader came or went. */
+            if (cmpxchg(&lock->count, count, count + 1))
+                break;
+            continue;
+        }
+        waited = true;
+        cpu_relax();
+    }
+
+    stats_register(&lock->stats);
+    atomic_fetch_add(&lock->stats.read_acquired, 1);
+    if (waited)
+        atomic_fetch_add(&lock->stats.read_contended, 1);
+    return flags;
+}
+
+void read_unlock_irqrestore(struct rwlock *lock, irqflags_t flags)
+{
+    atomic_fetch_add(&lock->count, -1);
+    local_irq_restore(flags);
+}
+
+irqflags_t write_lock_irqsave(struct rwlock *lock)
+{
+    irqflags_t flags = local_irq_save();
+    uint64_t wait_start = 0;
+
+    while (!cmpxchg(&lock->count, 0, RWLOCK_WRITER)) {
+        if (!wait_start)
+            wait_start = get_cycles();
+        cpu_relax();
+    }
+
+    lock->hold_start = get_cycles();
+    stats_acquired(&lock->stats, wait_start, lock->hold_start);
+    return flags;
+}
+
+void write_unlock_irqrestore(struct rwlock *lock, irqflags_t flags)
+{
+    stats_released(&lock->stats, lock->hold_start);
+
+    smp_store_release(&lock->count, 0);
+    local_irq_restore(flags);
+}
+
+/* Uncontended lock and unlock, statistics included */
+static void bench_spinlock(uint32_t iters)
+{
+    static struct spinlock lock = SPINLOCK_INIT("bench");
+
+    for (uint32_t i = 0; i < iters; i++) {
+        irqflags_t flags = spin_lock_irqsave(&lock);
+        spin_unlock_irqrestore(&lock, flags);
+    }
+}
+
+BENCHMARK(spinlock, bench_spinlock);
+
+static void show_lockstat(struct seqbuf *s)
+{
+    seq_printf(s, "%-16s %10s %10s %12s %12s %10s %10s\n",
+        "name", "acquired", "contended", "avg wait", "max hold",
+        "reads", "contended");
+
+    for (struct lock_stats *st = all_stats; st; st = st->next) {
+        uint64_t avg_wait = st->contended ?
+            st->wait_cycles / st->contended : 0;
+
+        seq_printf(s, "%-16s %10u %10u %12llu %12llu %10u %10u\n",
+            st->name ? st->name : "?", st->acquired, st->contended,
+            avg_wait, st->max_hold_cycles, st->read_acquired,
+            st->read_contended);
+    }
+
+    seq_printf(s, "\n(wait and hold times in TSC cycles)\n");
+}
+
+void lockstat_procinfo_setup()
+{
+    register_procinfo(PROCINFO_LOCKSTAT, show_lockstat);
+}
+
+core_initcall(lockstat_procinfo_setup);
@@ -0,0 +1,302 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/timer.c
+ *
+ * Timing wheel. Level 0 has a slot for each of the next 256 jiffies, the four
+ * levels above have 64 slots each, every slot covering as much time as the
+ * whole level below. When level 0 wraps around, the next slot of level 1 is
+ * emptied ("cascaded") into level 0, and so on up the levels.
+ *
+ * Timers may be started and stopped on any CPU, `wheel_lock` covers the wheel.
+ * Expired timers are taken off it one by one and run without the lock, so
+ * they can re-arm themselves.
+ * see also: kernel/include/timer.h
+ */
+
+#include "timer.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <irqflags.h>
+
+#include "ktime.h"
+#include "profile.h"
+#include "sched.h"
+#include "softirq.h"
+#include "spinlock.h"
+
+#define ROOT_BITS 8
+#define LVL_BITS 6
+#define ROOT_SIZE (1 << ROOT_BITS)
+#define LVL_SIZE (1 << LVL_BITS)
+#define ROOT_MASK (ROOT_SIZE - 1)
+#define LVL_MASK (LVL_SIZE - 1)
+
+#define NUM_LEVELS 4 /* above the root */
+
+/* Slot index of `expires` on level `lvl` (1-4). */
+#define LVL_INDEX(expires, lvl) \
+    (((expires) >> (ROOT_BITS + ((lvl) - 1) * LVL_BITS)) & LVL_MASK)
+
+volatile uint32_t jiffies;
+
+static struct timer *root[ROOT_SIZE];
+static struct timer *levels[NUM_LEVELS][LVL_SIZE];
+
+/* Next jiffy the wheel has to process. Lags behind `jiffies` while nothing is
+ * pending, then catches up in one step. */
+static uint32_t wheel_jiffies;
+
+static unsigned num_pending;
+
+static struct spinlock wheel_lock = SPINLOCK_INIT("timer_wheel");
+
+static const struct tick_device *tick_dev;
+
+/* Tickless idle state */
+static bool tick_stopped;
+static uint32_t stop_jiffies, stop_sleep;
+static uint64_t stop_ns;
+static uint64_t ticks_skipped;
+
+static void slot_add(struct timer **slot, struct timer *t)
+{
+    t->next = *slot;
+    if (t->next)
+        t->next->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+}
+
+static void unlink(struct timer *t)
+{
+    *t->pprev = t->next;
+    if (t->next)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+    num_pending--;
+}
+
+static void enqueue(struct timer *t)
+{
+    uint32_t expires = t->expires;
+    uint32_t delta = expires - wheel_jiffies;
+    struct timer **slot;
+
+    if ((int32_t)delta < 0) {
+        /* Already expired, run on the next tick. */
+        slot = &root[wheel_jiffies & ROOT_MASK];
+    } else if (delta < ROOT_SIZE) {
+        slot = &root[expires & ROOT_MASK];
+    } else {
+        int lvl = 1;
+        while (lvl < NUM_LEVELS &&
+                delta >= 1u << (ROOT_BITS + lvl * LVL_BITS))
+            lvl++;
+        slot = &levels[lvl - 1][LVL_INDEX(expires, lvl)];
+    }
+
+    slot_add(slot, t);
+}
+
+void mod_timer(struct timer *t, uint32_t expires)
+{
+    irqflags_t flags = spin_lock_irqsave(&wheel_lock);
+
+    if (timer_pending(t))
+        unlink(t);
+
+    /* Nothing pending means the wheel is empty and doesn't need to catch up
+     * slot by slot. */
+    if (num_pending == 0)
+        wheel_jiffies = jiffies;
+
+    t->expires = expires;
+    enqueue(t);
+    num_pending++;
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+bool del_timer(struct timer *t)
+{
+    irqflags_t flags = spin_lock_irqsave(&wheel_lock);
+
+    bool was_pending = timer_pending(t);
+    if (was_pending)
+        unlink(t);
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+    return was_pending;
+}
+
+/* Moves all timers of a slot on level `lvl` down to the levels below. Returns
+ * the slot index, so the caller knows whether this level wrapped too. Call
+ * with `wheel_lock` held. */
+static unsigned cascade(int lvl)
+{
+    unsigned index = LVL_INDEX(wheel_jiffies, lvl);
+    struct timer *t = levels[lvl - 1][index];
+
+    levels[lvl - 1][index] = NULL;
+
+    while (t) {
+        struct timer *next = t->next;
+        enqueue(t);
+        t = next;
+    }
+
+    return index;
+}
+
+/*
+ * Finds the earliest pending timer. Within a level, slots come in time order
+ * starting from the current one, so only the first non-empty slot of each
+ * level needs looking at. On the upper levels, the current slot was cascaded
+ * already, anything in it now is a whole round away, so it comes last.
+ */
+static bool next_expiry(uint32_t *expires)
+{
+    bool found = false;
+    uint32_t best = 0;
+
+    for (unsigned i = 0; i < ROOT_SIZE; i++) {
+        struct timer *t = root[(wheel_jiffies + i) & ROOT_MASK];
+        if (t) {
+            best = t->expires;
+            found = true;
+            break;
+        }
+    }
+
+    for (int lvl = 1; lvl <= NUM_LEVELS; lvl++) {
+        unsigned index = LVL_INDEX(wheel_jiffies, lvl);
+
+        for (unsigned i = 1; i <= LVL_SIZE; i++) {
+            struct timer *t = levels[lvl - 1][(index + i) & LVL_MASK];
+            if (!t)
+                continue;
+
+            for (; t; t = t->next) {
+                if (!found || time_before(t->expires, best))
+                    best = t->expires;
+                found = true;
+            }
+            break;
+        }
+    }
+
+    *expires = best;
+    return found;
+}
+
+void tick_set_device(const struct tick_device *dev)
+{
+    tick_dev = dev;
+}
+
+bool tick_nohz_stop()
+{
+    /* Without a better clocksource than jiffies themselves, there'd be no
+     * telling how many ticks we slept through. */
+    if (!tick_dev || !tick_dev->oneshot || clocksource->freq <= HZ)
+        return false;
+
+    uint32_t sleep = tick_dev->max_ticks;
+    uint32_t next;
+
+    irqflags_t flags = spin_lock_irqsave(&wheel_lock);
+    bool found = num_pending && next_expiry(&next);
+    spin_unlock_irqrestore(&wheel_lock, flags);
+
+    if (found) {
+        int32_t delta = next - jiffies;
+        if (delta <= 1)
+            return false;
+        if ((uint32_t)delta < sleep)
+            sleep = delta;
+    }
+    if (sleep <= 1)
+        return false;
+
+    stop_ns = ktime_get_ns();
+    stop_jiffies = jiffies;
+    stop_sleep = sleep;
+    tick_stopped = true;
+
+    tick_dev->oneshot(sleep);
+    return true;
+}
+
+void tick_nohz_restart()
+{
+    if (!tick_stopped)
+        return;
+    tick_stopped = false;
+
+    uint32_t elapsed = (ktime_get_ns() - stop_ns) / (NSEC_PER_SEC / HZ);
+
+    /* If the one-shot expired, its interrupt counts the last jiffy. */
+    if (elapsed >= stop_sleep)
+        elapsed = stop_sleep - 1;
+
+    jiffies = stop_jiffies + elapsed;
+    ticks_skipped += elapsed;
+
+    tick_dev->periodic();
+
+    if (num_pending)
+        raise_softirq(SOFTIRQ_TIMER);
+}
+
+uint64_t tick_nohz_skipped()
+{
+    return ticks_skipped;
+}
+
+void timer_tick()
+{
+    jiffies++;
+
+    if (num_pending)
+        raise_softirq(SOFTIRQ_TIMER);
+
+    sched_tick();
+    profile_tick();
+}
+
+static void timer_softirq()
+{
+    irqflags_t flags = spin_lock_irqsave(&wheel_lock);
+
+    while (num_pending && time_after_eq(jiffies, wheel_jiffies)) {
+        unsigned index = wheel_jiffies & ROOT_MASK;
+
+        if (index == 0) {
+            for (int lvl = 1; lvl <= NUM_LEVELS && cascade(lvl) == 0; lvl++)
+                ;
+        }
+
+        wheel_jiffies++;
+
+        struct timer *t;
+        while ((t = root[index])) {
+            unlink(t);
+
+            spin_unlock_irqrestore(&wheel_lock, flags);
+            /* May re-arm itself. */
+            t->fn(t->data);
+            flags = spin_lock_irqsave(&wheel_lock);
+        }
+    }
+
+    spin_unlock_irqrestore(&wheel_lock, flags);
+}
+
+void timer_init()
+{
+    open_softirq(SOFTIRQ_TIMER, timer_softirq);
+}
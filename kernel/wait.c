@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include "wait.h"
+
+#include <stddef.h>
+
+#include <irqflags.h>
+
+#include "sched.h"
+
+void prepare_to_wait(struct wait_queue *wq, struct waiter *w)
+{
+    w->thread = current;
+    w->pprev = &wq->head;
+    w->next = wq->head;
+    if (w->next)
+        w->next->pprev = &w->next;
+    wq->head = w;
+
+    current->state = THREAD_SLEEPING;
+}
+
+void finish_wait(struct waiter *w)
+{
+    irqflags_t flags = local_irq_save();
+
+    *w->pprev = w->next;
+    if (w->next)
+        w->next->pprev = w->pprev;
+    current->state = THREAD_RUNNING;
+
+    local_irq_restore(flags);
+}
+
+void wake_up(struct wait_queue *wq)
+{
+    irqflags_t flags = local_irq_save();
+
+    /* Waiters stay queued until they run `finish_wait()`. */
+    for (struct waiter *w = wq->head; w; w = w->next)
+        thread_wake(w->thread);
+
+    local_irq_restore(flags);
+}
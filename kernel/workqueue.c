@@ -0,0 +1,394 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+/*
+ * file: kernel/workqueue.c
+ *
+ * Work-stealing workers. Every CPU has a Chase-Lev deque: its owner pushes
+ * and takes at the bottom (newest first, still warm in the cache), other CPUs
+ * steal from the top (oldest first) with a compare-and-swap. Only taking the
+ * last item needs the owner to race the thieves, everything else the owner
+ * does is plain loads and stores.
+ *
+ * "Owner" is the CPU, not a thread: the owner side runs with interrupts
+ * disabled, so queueing from interrupt handlers can't interleave with it.
+ *
+ * The boot CPU runs its work in a thread, the other CPUs (which don't run
+ * threads yet) in `work_cpu_loop()`. Idle workers are woken with an IPI.
+ * see also: kernel/include/workqueue.h
+ */
+
+#include "workqueue.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic.h>
+#include <barrier.h>
+#include <initcall.h>
+#include <irqflags.h>
+#include <percpu.h>
+#include <drivers/procinfo.h>
+
+#include "bench.h"
+#include "ktime.h"
+#include "rcu.h"
+#include "sched.h"
+#include "wait.h"
+
+#define WORK_QUEUE_MASK (WORK_QUEUE_SIZE - 1)
+
+/* A steal that lost a race, worth trying again */
+#define STEAL_RETRY ((struct work *)1)
+
+#define BENCH_ITEMS 2048
+
+_Static_assert((WORK_QUEUE_SIZE & WORK_QUEUE_MASK) == 0,
+    "WORK_QUEUE_SIZE must be a power of two");
+_Static_assert(NR_CPUS <= 32, "idle_cpus too small");
+
+struct work_cpu {
+    /* Indices only ever grow, wrapping around. bottom - top items are
+     * queued. */
+    volatile uint32_t top;
+    volatile uint32_t bottom;
+    struct work *volatile items[WORK_QUEUE_SIZE];
+
+    /* Written by the owner only */
+    uint32_t queued, run, stolen, full;
+} __attribute__((aligned(64)));
+
+static struct work_cpu work_cpus[NR_CPUS];
+
+/* Bit n set while CPU n's worker sleeps */
+static volatile uint32_t idle_cpus;
+
+/* CPUs beyond this don't take part (for benchmarking) */
+static volatile unsigned active_cpus = NR_CPUS;
+
+static struct wait_queue kworker_wait = WAIT_QUEUE_INIT;
+
+static unsigned nr_workers()
+{
+    unsigned n = num_online_cpus();
+    return active_cpus < n ? active_cpus : n;
+}
+
+/* Owner only, interrupts disabled */
+static bool push(struct work_cpu *wc, struct work *w)
+{
+    uint32_t b = wc->bottom;
+    uint32_t t = smp_load_acquire(&wc->top);
+
+    if ((int32_t)(b - t) >= WORK_QUEUE_SIZE)
+        return false;
+
+    wc->items[b & WORK_QUEUE_MASK] = w;
+    smp_store_release(&wc->bottom, b + 1);
+    return true;
+}
+
+/* Owner only, interrupts disabled */
+static struct work *take(struct work_cpu *wc)
+{
+    uint32_t b = wc->bottom - 1;
+
+    /* Claim the bottom item first, then see if thieves got there too. */
+    wc->bottom = b;
+    smp_mb();
+    uint32_t t = wc->top;
+
+    if ((int32_t)(b - t) < 0) {
+        wc->bottom = b + 1;
+        return NULL;
+    }
+
+    struct work *w = wc->items[b & WORK_QUEUE_MASK];
+    if (b != t)
+        return w;
+
+    /* The last one, whoever moves top first gets it. */
+    if (!cmpxchg(&wc->top, t, t + 1))
+        w = NULL;
+    wc->bottom = b + 1;
+    return w;
+}
+
+static struct work *steal(struct work_cpu *wc)
+{
+    uint32_t t = smp_load_acquire(&wc->top);
+    smp_mb();
+    uint32_t b = smp_load_acquire(&wc->bottom);
+
+    if ((int32_t)(b - t) <= 0)
+        return NULL;
+
+    /* The slot can't be reused before top moves past it, and then our
+     * compare-and-swap fails. */
+    struct work *w = wc->items[t & WORK_QUEUE_MASK];
+    if (!cmpxchg(&wc->top, t, t + 1))
+        return STEAL_RETRY;
+    return w;
+}
+
+/* Whether `cpu` has work to take or steal. CPUs not taking part never do, so
+ * they stay asleep. */
+static bool work_available(unsigned cpu)
+{
+    unsigned n = nr_workers();
+    if (cpu >= n)
+        return false;
+
+    for (unsigned i = 0; i < n; i++) {
+        struct work_cpu *wc = &work_cpus[i];
+        if ((int32_t)(wc->bottom - wc->top) > 0)
+            return true;
+    }
+    return false;
+}
+
+/* Clears an idle CPU's bit, so only one waker sends it an IPI. */
+static int claim_idle(uint32_t mask)
+{
+    while (1) {
+        uint32_t idle = idle_cpus & mask;
+        if (!idle)
+            return -1;
+
+        unsigned cpu = __builtin_ctz(idle);
+        uint32_t old = idle_cpus;
+        if ((old & (1u << cpu)) &&
+                cmpxchg(&idle_cpus, old, old & ~(1u << cpu)))
+            return cpu;
+    }
+}
+
+bool queue_work(struct work *w)
+{
+    irqflags_t flags = local_irq_save();
+
+    unsigned self = smp_processor_id();
+    struct work_cpu *wc = &work_cpus[self];
+    bool ok = push(wc, w);
+
+    if (ok)
+        wc->queued++;
+    else
+        wc->full++;
+
+    local_irq_restore(flags);
+
+    if (!ok)
+        return false;
+
+    /* Our own worker may be asleep, then one more CPU can help out. The
+     * barrier pairs with the one in `set_idle()`: either we see the worker
+     * idle, or it sees the new work. */
+    smp_mb();
+
+    uint32_t active = nr_workers() >= 32 ? ~0u : (1u << nr_workers()) - 1;
+    if (claim_idle(active & (1u << self)) >= 0)
+        work_kick();
+
+    int cpu = claim_idle(active & ~(1u << self));
+    if (cpu >= 0)
+        smp_send_wake(cpu);
+
+    return true;
+}
+
+/* Takes a work item from this CPU, or steals one, and runs it. */
+static bool run_one()
+{
+    unsigned self = smp_processor_id();
+    unsigned n = nr_workers();
+    if (self >= n)
+        return false;
+
+    struct work_cpu *wc = &work_cpus[self];
+
+    irqflags_t flags = local_irq_save();
+    struct work *w = take(wc);
+    local_irq_restore(flags);
+
+    for (unsigned i = 1; !w && i < n; i++) {
+        struct work_cpu *victim = &work_cpus[(self + i) % n];
+        while ((w = steal(victim)) == STEAL_RETRY)
+            ;
+        if (w)
+            wc->stolen++;
+    }
+
+    if (!w)
+        return false;
+
+    wc->run++;
+    w->fn(w);
+
+    /* Work can't leave a read section open. */
+    rcu_note_qs();
+    return true;
+}
+
+/* Returns whether to go to sleep (or whether there's work after all). */
+static bool set_idle(unsigned cpu)
+{
+    atomic_or(&idle_cpus, 1u << cpu);
+    if (!work_available(cpu))
+        return true;
+
+    atomic_and(&idle_cpus, ~(1u << cpu));
+    return false;
+}
+
+void work_kick()
+{
+    /* Other CPUs just return from `hlt`. */
+    if (smp_processor_id() == 0)
+        wake_up(&kworker_wait);
+}
+
+void work_cpu_loop()
+{
+    unsigned self = smp_processor_id();
+
+    rcu_idle_exit();
+
+    while (1) {
+        while (run_one())
+            ;
+
+        if (!set_idle(self))
+            continue;
+
+        /* A wakeup IPI arriving now stays pending until the `hlt`. */
+        local_irq_disable();
+        if (work_available(self)) {
+            local_irq_enable();
+        } else {
+            rcu_idle_enter();
+            arch_safe_halt();
+            rcu_idle_exit();
+        }
+
+        atomic_and(&idle_cpus, ~(1u << self));
+    }
+}
+
+static void kworker(void *arg)
+{
+    (void)arg;
+
+    while (1) {
+        while (run_one())
+            ;
+
+        if (!set_idle(0))
+            continue;
+
+        wait_event(&kworker_wait, work_available(0));
+        atomic_and(&idle_cpus, ~1u);
+    }
+}
+
+struct bench_item {
+    struct work work; /* first, so the work pointer is the item's */
+    uint32_t cost;
+    uint32_t result;
+};
+
+static volatile uint32_t bench_done;
+
+static void bench_fn(struct work *w)
+{
+    struct bench_item *item = (struct bench_item *)w;
+    uint32_t x = item->cost | 1;
+
+    for (uint32_t i = 0; i < item->cost; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+
+    item->result = x;
+    atomic_fetch_add(&bench_done, 1);
+}
+
+/* Work throughput with 1 up to all CPUs */
+static void workqueue_bench()
+{
+    struct bench_item *items = malloc(BENCH_ITEMS * sizeof(*items));
+    if (!items)
+        return;
+
+    /* Mostly small items, some ten times and a few hundred times as
+     * expensive. */
+    for (unsigned i = 0; i < BENCH_ITEMS; i++) {
+        items[i].work.fn = bench_fn;
+        items[i].cost = i % 20 == 0 ? 200000 : i % 4 == 0 ? 20000 : 2000;
+    }
+
+    uint64_t base_ns = 0;
+
+    for (unsigned n = 1; n <= num_online_cpus(); n++) {
+        active_cpus = n;
+        bench_done = 0;
+        smp_mb();
+
+        uint64_t start = ktime_get_ns();
+
+        /* Queue everything from here, the other CPUs have to steal it. We
+         * help out while waiting. */
+        unsigned queued = 0;
+        while (bench_done < BENCH_ITEMS) {
+            while (queued < BENCH_ITEMS && queue_work(&items[queued].work))
+                queued++;
+            run_one();
+        }
+
+        uint64_t ns = ktime_get_ns() - start;
+        ns = ns ? ns : 1;
+        if (n == 1)
+            base_ns = ns;
+
+        printf("info: workqueue: %u CPU(s): %llu items/s, speedup %llu.%02llu\n",
+            n, BENCH_ITEMS * NSEC_PER_SEC / ns, base_ns / ns,
+            base_ns * 100 / ns % 100);
+
+        char name[32];
+        snprintf(name, sizeof(name), "workqueue.cpus%u", n);
+        bench_report(name, BENCH_ITEMS * NSEC_PER_SEC / ns, "items/s",
+            BENCH_HIGHER_IS_BETTER);
+    }
+
+    active_cpus = NR_CPUS;
+    free(items);
+}
+
+BENCHMARK_RUN(workqueue, workqueue_bench);
+
+static void show_workqueue(struct seqbuf *s)
+{
+    seq_printf(s, "%4s %10s %10s %10s %10s %8s\n",
+        "cpu", "queued", "run", "stolen", "full", "pending");
+
+    for (unsigned i = 0; i < num_online_cpus(); i++) {
+        struct work_cpu *wc = &work_cpus[i];
+        seq_printf(s, "%4u %10u %10u %10u %10u %8d%s\n",
+            i, wc->queued, wc->run, wc->stolen, wc->full,
+            (int32_t)(wc->bottom - wc->top),
+            idle_cpus & (1u << i) ? " idle" : "");
+    }
+}
+
+void workqueue_init()
+{
+    if (!thread_create("kworker", PRIO_DEFAULT, kworker, NULL))
+        printf("err: workqueue: no memory for the worker thread\n");
+
+    register_procinfo(PROCINFO_WORKQUEUE, show_workqueue);
+}
+
+core_initcall(workqueue_init);
@@ -8,7 +8,11 @@
 #ifdef __is_kernel
 
 #include <stdio.h>
+#include <string.h>
 
+#include <bench.h>
+#include <percpu.h>
+#include <spinlock.h>
 #include <x86/mem.h>
 
 enum alloc_status {
@@ -19,6 +23,8 @@ enum alloc_status {
 /* TODO: Guarantee max alignment on changes to structure! */
 struct alloc_header {
     uint8_t status;
+    /* Size class + 1 if the block belongs to the object caches, else 0 */
+    uint8_t cache;
     size_t size;
     
     struct alloc_header *prev_header;
@@ -26,6 +32,32 @@ struct alloc_header {
     uint32_t _pad;
 };
 
+/*
+ * Small allocations are served from per-CPU caches: every CPU keeps a
+ * magazine (a stack) of free objects for each size class, so most of them
+ * only pop or push CPU-local memory with interrupts disabled. An empty
+ * magazine is refilled with a batch from the heap, a full one drains a batch
+ * back to it.
+ *
+ * Cached objects stay allocated as far as the heap is concerned, their header
+ * just remembers the size class to go back to.
+ */
+#define NR_SIZE_CLASSES 7 /* 16 bytes to 1 KiB */
+#define MIN_CLASS_SHIFT 4
+#define MAGAZINE_SIZE 32
+#define MAGAZINE_BATCH (MAGAZINE_SIZE / 2)
+
+struct magazine {
+    size_t n;
+    void *objs[MAGAZINE_SIZE];
+};
+
+struct cpu_cache {
+    struct magazine mags[NR_SIZE_CLASSES];
+} __attribute__((aligned(64)));
+
+static struct cpu_cache cpu_caches[NR_CPUS];
+
 static struct alloc_header *first_hdr;
 
 static struct alloc_header *find_next_hdr(struct alloc_header *hdr)
@@ -33,7 +65,119 @@ static struct alloc_header *find_next_hdr(struct alloc_header *hdr)
     return (void *)hdr + sizeof(struct alloc_header) + hdr->size;
 }
 
+/* The heap is shared by all CPUs, threads and interrupt handlers. */
+static struct spinlock heap_lock = SPINLOCK_INIT("heap");
+
+static void *do_malloc(size_t size);
+static void do_free(void *ptr);
+
+/* Returns the smallest class `size` fits, or -1 if it's too large. */
+static int size_class(size_t size)
+{
+    for (int class = 0; class < NR_SIZE_CLASSES; class++) {
+        if (size <= (size_t)1 << (class + MIN_CLASS_SHIFT))
+            return class;
+    }
+    return -1;
+}
+
+/* Called with interrupts disabled */
+static void refill(struct magazine *mag, int class)
+{
+    size_t size = (size_t)1 << (class + MIN_CLASS_SHIFT);
+
+    irqflags_t flags = spin_lock_irqsave(&heap_lock);
+    while (mag->n < MAGAZINE_BATCH) {
+        void *ptr = do_malloc(size);
+        if (!ptr)
+            break;
+
+        ((struct alloc_header *)ptr - 1)->cache = class + 1;
+        mag->objs[mag->n++] = ptr;
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
+}
+
+/* Called with interrupts disabled. Frees the objects at the bottom of the
+ * stack, the ones on top were freed last and are more likely still cached. */
+static void drain(struct magazine *mag)
+{
+    irqflags_t flags = spin_lock_irqsave(&heap_lock);
+    for (size_t i = 0; i < MAGAZINE_BATCH; i++) {
+        ((struct alloc_header *)mag->objs[i] - 1)->cache = 0;
+        do_free(mag->objs[i]);
+    }
+    spin_unlock_irqrestore(&heap_lock, flags);
+
+    mag->n -= MAGAZINE_BATCH;
+    memmove(mag->objs, &mag->objs[MAGAZINE_BATCH], mag->n * sizeof(void *));
+}
+
 void *malloc(size_t size)
+{
+    int class = size_class(size);
+    if (class < 0) {
+        irqflags_t flags = spin_lock_irqsave(&heap_lock);
+        void *ptr = do_malloc(size);
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return ptr;
+    }
+
+    irqflags_t flags = local_irq_save();
+
+    struct magazine *mag = &cpu_caches[smp_processor_id()].mags[class];
+    if (!mag->n)
+        refill(mag, class);
+    void *ptr = mag->n ? mag->objs[--mag->n] : NULL;
+
+    local_irq_restore(flags);
+    return ptr;
+}
+
+void free(void *ptr)
+{
+    struct alloc_header *hdr = (struct alloc_header *)ptr - 1;
+
+    if (!hdr->cache) {
+        irqflags_t flags = spin_lock_irqsave(&heap_lock);
+        do_free(ptr);
+        spin_unlock_irqrestore(&heap_lock, flags);
+        return;
+    }
+
+    irqflags_t flags = local_irq_save();
+
+    struct magazine *mag = &cpu_caches[smp_processor_id()].mags[hdr->cache - 1];
+    if (mag->n == MAGAZINE_SIZE)
+        drain(mag);
+    mag->objs[mag->n++] = ptr;
+
+    local_irq_restore(flags);
+}
+
+/* Object cache hits, and the locked heap underneath. */
+static void bench_malloc(uint32_t iters, size_t size)
+{
+    for (uint32_t i = 0; i < iters; i++) {
+        void *volatile ptr = malloc(size);
+        free(ptr);
+    }
+}
+
+static void bench_malloc_small(uint32_t iters)
+{
+    bench_malloc(iters, 64);
+}
+
+static void bench_malloc_large(uint32_t iters)
+{
+    bench_malloc(iters, 4096);
+}
+
+BENCHMARK(malloc_small, bench_malloc_small);
+BENCHMARK(malloc_large, bench_malloc_large);
+
+static void *do_malloc(size_t size)
 {
     /* Guarantee max alignment: round up size to the nearest multiple of 16 */
     size = (size + 15) & ~15;
@@ -57,6 +201,7 @@ void *malloc(size_t size)
                 DEFAULT_PAGE_FLAGS);
         
         new_hdr->status = END_OF_MEMORY;
+        new_hdr->cache = 0;
         new_hdr->size = n * PAGE_SIZE - sizeof(struct alloc_header);
         new_hdr->prev_header = hdr;
 
@@ -79,6 +224,7 @@ void *malloc(size_t size)
 
         struct alloc_header *next_hdr = find_next_hdr(hdr);
         next_hdr->status = 0;
+        next_hdr->cache = 0;
         next_hdr->prev_header = hdr;
         next_hdr->size = remaining;
 
@@ -94,7 +240,7 @@ void *malloc(size_t size)
     return &hdr[1];
 }
 
-void free(void *ptr)
+static void do_free(void *ptr)
 {
     struct alloc_header *hdr = ((struct alloc_header *)ptr) - 1;
 
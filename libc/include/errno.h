@@ -65,4 +65,26 @@
  */
 #define ENODEV 10
 
+/**
+ * @brief Resource unavailable, try again.
+ * e.g. a non-blocking write to a device whose buffers are full
+ */
+#define EAGAIN 11
+
+/**
+ * @brief Invalid argument.
+ */
+#define EINVAL 12
+
+/**
+ * @brief Not enough space.
+ * e.g. the kernel heap is exhausted
+ */
+#define ENOMEM 13
+
+/**
+ * @brief No such file or directory.
+ */
+#define ENOENT 14
+
 #endif
@@ -11,6 +11,25 @@
 #define __STDIO_H
 
 #include <stdarg.h>
+#include <stddef.h>
+
+/**
+ * @brief Print format into a buffer
+ *
+ * @arg buf Destination, always null-terminated (if `size` isn't 0)
+ * @arg size Size of `buf`, output beyond it is cut off
+ * @arg format Format string, see `printf()`
+ * @returns Number of characters the whole output has (without the null), even
+ * if it was cut off
+ */
+int snprintf(char *buf, size_t size, const char *format, ...);
+
+/**
+ * @brief Print format into a buffer from va_list
+ *
+ * Like `snprintf()`, but accepts a `va_list` directly instead of varargs.
+ */
+int vsnprintf(char *buf, size_t size, const char *format, va_list args);
 
 #ifdef __is_kernel
 
@@ -60,11 +79,15 @@ int puts(const char *s);
  *  `%%u`       | `unsigned`     | Converts an unsigned integer to decimal
  *  `%%x`/`%%X` | `unsigned`     | Converts an unsigned integer to hexadecimal
  *  `%%o`       | `unsigned`     | Converts an unsigned integer to hexadecimal
+ *  `%%p`       | `void *`       | Like `%%x`, prefixed with `0x`
  *  `%%n`       | `int *`        | Returns number of characters written so far
  * 
  * The following modifiers are supported:
+ * - `-` (left-justify)
  * - `0`
- * - integer value for length
+ * - integer value for length (also for `%%s`)
+ * - `ll` for `long long` arguments (`l` and `z` are accepted, but `long` and
+ *   `size_t` are the same size as `int` anyway)
  * 
  * @see https://en.cppreference.com/w/cpp/io/c/fprintf
  * for all format specifiers defined by the standard
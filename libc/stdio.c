@@ -2,45 +2,228 @@
 #include <stdio.h>
 
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #include <string.h>
 
 #ifdef __is_kernel
-
 #include <drivers/tty.h>
+#endif
+
+/* Console output is collected in chunks of this size. */
+#define OUT_CHUNK 64
+
+/*
+ * Where formatted output goes: into `buf` (at most `size` bytes including the
+ * terminating null), or, if `buf` is NULL, to the console in chunks.
+ */
+struct out {
+    char *buf;
+    size_t size;
+    size_t len;
+
+    char chunk[OUT_CHUNK];
+    size_t chunk_len;
+};
+
+static void out_flush(struct out *o)
+{
+#ifdef __is_kernel
+    if (o->chunk_len)
+        console_write(o->chunk, o->chunk_len);
+#endif
+    o->chunk_len = 0;
+}
+
+static void out_char(struct out *o, char ch)
+{
+    if (o->buf) {
+        if (o->len + 1 < o->size)
+            o->buf[o->len] = ch;
+    } else {
+        if (o->chunk_len == OUT_CHUNK)
+            out_flush(o);
+        o->chunk[o->chunk_len++] = ch;
+    }
+    o->len++;
+}
+
+static void out_pad(struct out *o, int n, char filler)
+{
+    for (int i = 0; i < n; i++)
+        out_char(o, filler);
+}
+
+static void out_str(struct out *o, const char *s, int min, bool left)
+{
+    int n = strlen(s);
+
+    if (!left)
+        out_pad(o, min - n, ' ');
+    while (*s)
+        out_char(o, *s++);
+    if (left)
+        out_pad(o, min - n, ' ');
+}
 
-static int putiradix(unsigned x, int r, char alpha, int min, char filler)
+static void out_radix(struct out *o, unsigned long long x, unsigned r,
+        char alpha, int min, char filler, bool left)
 {
-    char digits[11];
-    int d, n = 0, i;
+    char digits[22];
+    int n = 0;
+
     do {
-        d = x % r;
-        if (d < 10) {
-            digits[n] = '0' + d;
+        unsigned d;
+        /* Stay clear of 64-bit division where it isn't needed. */
+        if (x <= 0xffffffff) {
+            d = (unsigned)x % r;
+            x = (unsigned)x / r;
         } else {
-            digits[n] = alpha + d - 10;
+            d = x % r;
+            x /= r;
         }
-        x /= r;
-        n++;
-    } while(x);
-    for (i = 0; i < min - n; i++) {
-        putchar(filler);
-    }
-    for (i = n - 1; i >= 0; i--) {
-        putchar(digits[i]);
+        digits[n++] = d < 10 ? '0' + d : alpha + d - 10;
+    } while (x);
+
+    if (!left)
+        out_pad(o, min - n, filler);
+    for (int i = n - 1; i >= 0; i--)
+        out_char(o, digits[i]);
+    if (left)
+        out_pad(o, min - n, ' ');
+}
+
+static int format(struct out *o, const char *format, va_list args)
+{
+    while (*format) {
+        if (*format != '%') {
+            out_char(o, *format++);
+            continue;
+        }
+        format++;
+
+        bool left = false;
+        char num_filler = ' ';
+        int num_min = 0;
+        int longs = 0;
+
+        if (*format == '-') {
+            left = true;
+            format++;
+        }
+        if (*format == '0') {
+            num_filler = '0';
+            format++;
+        }
+        while (*format >= '0' && *format <= '9') {
+            num_min *= 10;
+            num_min += *format - '0';
+            format++;
+        }
+        while (*format == 'l') {
+            longs++;
+            format++;
+        }
+        if (*format == 'z')
+            format++;
+
+        unsigned long long u;
+        long long d;
+
+        switch (*format) {
+        case '%':
+            out_char(o, '%');
+            break;
+        case 's':
+            out_str(o, va_arg(args, const char *), num_min, left);
+            break;
+        case 'c':
+            out_char(o, va_arg(args, int));
+            break;
+        case 'd':
+        case 'i':
+            d = longs >= 2 ? va_arg(args, long long) : va_arg(args, int);
+            if (d < 0) {
+                out_char(o, '-');
+                num_min--;
+                u = -(unsigned long long)d;
+            } else {
+                u = d;
+            }
+            out_radix(o, u, 10, 0, num_min, num_filler, left);
+            break;
+        case 'u':
+        case 'p':
+        case 'x':
+        case 'X':
+        case 'o':
+            u = longs >= 2 ? va_arg(args, unsigned long long) :
+                va_arg(args, unsigned);
+            if (*format == 'u')
+                out_radix(o, u, 10, 0, num_min, num_filler, left);
+            else if (*format == 'o')
+                out_radix(o, u, 8, 0, num_min, num_filler, left);
+            else if (*format == 'X')
+                out_radix(o, u, 16, 'A', num_min, num_filler, left);
+            else {
+                if (*format == 'p')
+                    out_str(o, "0x", 0, false);
+                out_radix(o, u, 16, 'a', num_min, num_filler, left);
+            }
+            break;
+        case 'n':
+            *va_arg(args, int *) = o->len;
+            break;
+        case '\0':
+            out_char(o, '%');
+            return o->len;
+        default:
+            out_char(o, *format);
+        }
+        format++;
     }
-    return min > n ? min : n;
+    return o->len;
+}
+
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+{
+    /* With size 0, only count. */
+    char dummy;
+    struct out o = {
+        .buf = size ? buf : &dummy,
+        .size = size,
+    };
+
+    int n = format(&o, fmt, args);
+    if (size)
+        buf[o.len < size ? o.len : size - 1] = '\0';
+    return n;
 }
 
+int snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+
+    int ret = vsnprintf(buf, size, fmt, args);
+
+    va_end(args);
+
+    return ret;
+}
+
+#ifdef __is_kernel
+
 int putchar(int ch)
 {
-    vconsole_write((char *) &ch, 1);
+    console_write((char *) &ch, 1);
     return ch;
 }
 
 int puts(const char *s)
 {
-    return vconsole_write(s, strlen(s));
+    return console_write(s, strlen(s));
 }
 
 int printf(const char *format, ...)
@@ -55,95 +238,12 @@ int printf(const char *format, ...)
     return ret;
 }
 
-int vprintf(const char *format, va_list args)
+int vprintf(const char *fmt, va_list args)
 {
-    /* Potential format args */
-    const char *s;
-    char c;
-    int d;
-    int *p;
-
-    int num_min;
-    char num_filler;
+    struct out o = { 0 };
 
-    int n = 0;
-
-    while (*format) {
-        num_min = 0;
-        num_filler = ' ';
-        if (*format == '%') {
-            format++;
-            if (*format == '0') {
-                num_filler = '0';
-                format++;
-            }
-            while (*format >= '0' && *format <= '9') {
-                num_min *= 10;
-                num_min += *format - '0';
-                format++;
-            }
-            switch (*format) {
-            case '%':
-                putchar('%');
-                n++;
-                break;
-            case 's':
-                s = va_arg(args, const char *);
-                n += puts(s);
-                break;
-            case 'c':
-                c = va_arg(args, int);
-                putchar(c);
-                n++;
-                break;
-            case 'd':
-            case 'i':
-                d = va_arg(args, int);
-                if (d < 0) {
-                    putchar('-');
-                    n++;
-                    d = -d;
-                }
-                n += putiradix(d, 10, 0, num_min, num_filler);
-                break;
-            case 'u':
-                d = va_arg(args, unsigned);
-                n += putiradix(d, 10, 0, num_min, num_filler);
-                break;
-            case 'p':
-                n += puts("0x");
-                /* fallthrough */
-            case 'x':
-                printf("");
-                d = va_arg(args, unsigned);
-                n += putiradix(d, 16, 'a', num_min, num_filler);
-                break;
-            case 'X':
-                d = va_arg(args, unsigned);
-                n += putiradix(d, 16, 'A', num_min, num_filler);
-                break;
-            case 'o':
-                d = va_arg(args, unsigned);
-                n += putiradix(d, 8, 0, num_min, num_filler);
-                break;
-            case 'n':
-                p = va_arg(args, int *);
-                *p = n;
-                break;
-            case '\0':
-                putchar('%');
-                n++;
-                return n;
-            default:
-                putchar(*format);
-            }
-            format++;
-        } else {
-            putchar(*format);
-            format++;
-            n++;
-        }
-    }
+    int n = format(&o, fmt, args);
+    out_flush(&o);
     return n;
 }
 
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+"""
+Boots the kernel headless in QEMU, runs in-kernel benchmarks and compares
+their results against a baseline.
+
+    tools/bench.py workqueue vconsole
+
+builds an ISO from the sysroot (`make install-all`) that boots straight into
+the kernel with `bench=<name>` for every benchmark named, `console=serial`,
+and `qemu_exit`, which has the kernel exit QEMU through the isa-debug-exit
+device once done. The results it prints to COM1 (see kernel/include/bench.h)
+are saved as JSON. Every such boot also reports the longest interrupts-off
+and preemption-off windows (irqsoff.*), which are compared as well.
+
+Results worse than the baseline by more than the threshold fail the run. With
+no baseline yet, or with --update-baseline, the results become the baseline.
+Baselines only make sense on the machine they were taken on.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+# Reported by every benchmark boot, not picked with `bench=`
+ALWAYS = {"irqsoff"}
+
+RESULT = re.compile(r"bench: result (\S+) (\d+) (\S+) (higher|lower)")
+
+GRUB_CFG = """set timeout=0
+set default=0
+
+menuentry "*nix (benchmarks)" {{
+    set gfxpayload=text
+    multiboot2 /boot/asternix.bin {cmdline}
+    module2 /boot/ramdisk
+}}
+"""
+
+# isa-debug-exit exits with (code << 1) | 1, the kernel writes 0.
+QEMU_EXIT_OK = 1
+
+
+def build_iso(sysroot, ramdisk, cmdline, workdir):
+    root = os.path.join(workdir, "iso")
+    os.makedirs(os.path.join(root, "boot", "grub"))
+    shutil.copy(os.path.join(sysroot, "boot", "asternix.bin"),
+                os.path.join(root, "boot"))
+    shutil.copy(ramdisk, os.path.join(root, "boot", "ramdisk"))
+    with open(os.path.join(root, "boot", "grub", "grub.cfg"), "w") as f:
+        f.write(GRUB_CFG.format(cmdline=cmdline))
+
+    iso = os.path.join(workdir, "bench.iso")
+    subprocess.run(["grub-mkrescue", root, "-o", iso], check=True,
+                   capture_output=True)
+    return iso
+
+
+def boot(iso, smp, timeout):
+    """Returns the serial output, or exits if the kernel didn't finish."""
+    cmd = ["qemu-system-i386", "-cdrom", iso, "-smp", str(smp),
+           "-nographic", "-no-reboot",
+           "-device", "isa-debug-exit,iobase=0xf4,iosize=0x04"]
+    try:
+        proc = subprocess.run(cmd, stdin=subprocess.DEVNULL,
+                              capture_output=True, timeout=timeout)
+    except subprocess.TimeoutExpired as e:
+        sys.stdout.write((e.stdout or b"").decode(errors="replace"))
+        sys.exit("bench: timed out after %d s" % timeout)
+
+    log = proc.stdout.decode(errors="replace")
+    if proc.returncode != QEMU_EXIT_OK:
+        sys.stdout.write(log)
+        sys.exit("bench: QEMU exited with %d, the kernel didn't finish"
+                 % proc.returncode)
+    return log
+
+
+def parse(log):
+    results = {}
+    for line in log.splitlines():
+        m = RESULT.search(line)
+        if m:
+            results[m.group(1)] = {"value": int(m.group(2)),
+                                   "unit": m.group(3),
+                                   "better": m.group(4)}
+    return results
+
+
+def compare(results, baseline, benches, threshold):
+    """Prints a table, returns the number of regressions and missing results."""
+    # Only the benchmarks asked for this time, whether they printed anything
+    # or not
+    baseline = {name: base for name, base in baseline.items()
+                if name.split(".")[0] in benches}
+
+    failures = 0
+    print("%-28s %14s %14s %8s" % ("result", "baseline", "now", "change"))
+
+    for name in sorted(set(baseline) | set(results)):
+        base, now = baseline.get(name), results.get(name)
+        if not now:
+            print("%-28s %14d %14s %8s  MISSING" % (name, base["value"], "-",
+                                                   "-"))
+            failures += 1
+            continue
+        if not base:
+            print("%-28s %14s %14d %8s  new" % (name, "-", now["value"], "-"))
+            continue
+
+        change = (now["value"] - base["value"]) / max(base["value"], 1)
+        worse = -change if now["better"] == "higher" else change
+        verdict = "REGRESSION" if worse > threshold else ""
+        failures += bool(verdict)
+        print("%-28s %14d %14d %+7.1f%%  %s" % (name, base["value"],
+              now["value"], change * 100, verdict))
+
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("benches", nargs="*", default=["workqueue"],
+                        help="benchmarks to run (default: workqueue)")
+    parser.add_argument("--sysroot", default="sysroot")
+    parser.add_argument("--ramdisk", default="ramdisk")
+    parser.add_argument("--smp", type=int, default=4)
+    parser.add_argument("--timeout", type=int, default=300,
+                        help="seconds to wait for the kernel (default: 300)")
+    parser.add_argument("--log", default="bench-serial.log",
+                        help="where to save the serial output")
+    parser.add_argument("--from-log", metavar="LOG",
+                        help="don't boot, take the results from a saved log")
+    parser.add_argument("--output", default="bench-results.json")
+    parser.add_argument("--baseline", default="bench-baseline.json")
+    parser.add_argument("--threshold", type=float, default=10,
+                        help="allowed regression in percent (default: 10)")
+    parser.add_argument("--update-baseline", action="store_true")
+    args = parser.parse_args()
+
+    if args.from_log:
+        with open(args.from_log) as f:
+            log = f.read()
+    else:
+        cmdline = " ".join(["bench=" + b for b in args.benches] +
+                           ["console=serial", "qemu_exit"])
+        with tempfile.TemporaryDirectory() as workdir:
+            iso = build_iso(args.sysroot, args.ramdisk, cmdline, workdir)
+            log = boot(iso, args.smp, args.timeout)
+        with open(args.log, "w") as f:
+            f.write(log)
+
+    if "bench: done" not in log:
+        sys.exit("bench: no `bench: done` in the output")
+
+    results = parse(log)
+    with open(args.output, "w") as f:
+        json.dump({"smp": args.smp, "results": results}, f, indent=2,
+                  sort_keys=True)
+        f.write("\n")
+
+    if args.update_baseline or not os.path.exists(args.baseline):
+        shutil.copy(args.output, args.baseline)
+        print("bench: saved %d result(s) as the baseline in %s"
+              % (len(results), args.baseline))
+        return
+
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    if baseline.get("smp") != args.smp:
+        print("bench: warning: baseline taken with -smp %s"
+              % baseline.get("smp"), file=sys.stderr)
+
+    failures = compare(results, baseline["results"],
+                       set(args.benches) | ALWAYS, args.threshold / 100)
+    if failures:
+        sys.exit("bench: %d result(s) missing or regressed beyond %g%%"
+                 % (failures, args.threshold))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+"""
+Turns the trace the kernel prints after booting with `ftrace` (built with
+`make FTRACE=1`) into per-function call counts and times.
+
+    tools/ftrace-report.py kernel/asternix.bin serial.log
+
+Inclusive time counts everything between a function's entry and its exit,
+exclusive time leaves out the functions it called. Both include the interrupt
+handlers and other threads that ran in between, so they're rough for anything
+that sleeps.
+"""
+
+import argparse
+import collections
+import sys
+
+from ksyms import Symbols, between
+
+
+class Stats:
+    def __init__(self):
+        self.calls = 0
+        self.inclusive = 0
+        self.exclusive = 0
+
+
+def read_events(lines):
+    for line in between(lines, "ftrace: begin", "ftrace: end"):
+        fields = line.split()
+        try:
+            yield (int(fields[0]), fields[1], int(fields[2], 16),
+                   int(fields[3], 16))
+        except (ValueError, IndexError):
+            print("skipping garbled line: " + line, file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("binary", help="the kernel the trace was taken on")
+    parser.add_argument("log", nargs="?", help="serial log (default: stdin)")
+    parser.add_argument("--mhz", type=float,
+                        help="TSC frequency, to print microseconds")
+    parser.add_argument("-n", type=int, default=30,
+                        help="how many functions to list (default: 30)")
+    args = parser.parse_args()
+
+    symbols = Symbols(args.binary)
+    log = open(args.log, errors="replace") if args.log else sys.stdin
+
+    stats = collections.defaultdict(Stats)
+    # Per CPU: [fn, entry tsc, cycles spent in callees]
+    stacks = collections.defaultdict(list)
+    unmatched = 0
+
+    for cpu, kind, tsc, fn in read_events(log):
+        stack = stacks[cpu]
+        if kind == "e":
+            stack.append([fn, tsc, 0])
+            continue
+
+        # The ring may have dropped the entry, or a thread switch interleaved
+        # another call chain: unwind to the matching frame, if there is one.
+        if not any(frame[0] == fn for frame in stack):
+            unmatched += 1
+            continue
+        while True:
+            frame_fn, start, children = stack.pop()
+            inclusive = tsc - start
+            if frame_fn == fn:
+                break
+
+        st = stats[fn]
+        st.calls += 1
+        st.inclusive += inclusive
+        st.exclusive += inclusive - children
+        if stack:
+            stack[-1][2] += inclusive
+
+    if not stats:
+        sys.exit("no trace found, was the kernel built with FTRACE=1?")
+
+    unit = "us" if args.mhz else "cycles"
+    scale = 1 / args.mhz if args.mhz else 1
+    prec = 2 if args.mhz else 0
+
+    print("%-32s %8s %14s %14s %12s" % ("function", "calls",
+          "incl " + unit, "excl " + unit, "avg excl"))
+    top = sorted(stats.items(), key=lambda kv: kv[1].exclusive, reverse=True)
+    for fn, st in top[:args.n]:
+        print("%-32s %8d %14.*f %14.*f %12.*f" % (
+            symbols.name(fn)[:32], st.calls, prec, st.inclusive * scale,
+            prec, st.exclusive * scale,
+            prec + 1, st.exclusive * scale / st.calls))
+
+    if unmatched:
+        print("\n%d exit(s) without an entry" % unmatched)
+
+
+if __name__ == "__main__":
+    main()
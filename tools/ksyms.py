@@ -0,0 +1,55 @@
+# SPDX-License-Identifier: GPL-3.0-or-later
+"""Kernel symbol lookup for the host-side tools, through `nm`."""
+
+import bisect
+import os
+import shutil
+import subprocess
+
+
+def find_nm():
+    if os.environ.get("NM"):
+        return os.environ["NM"]
+    return "i686-elf-nm" if shutil.which("i686-elf-nm") else "nm"
+
+
+class Symbols:
+    """The function symbols of a kernel binary, by address."""
+
+    def __init__(self, binary):
+        out = subprocess.run(
+            [find_nm(), "-n", "--defined-only", binary],
+            check=True, capture_output=True, text=True).stdout
+
+        self.addrs, self.names = [], []
+        for line in out.splitlines():
+            fields = line.split()
+            if len(fields) != 3 or fields[1] not in "tTwW":
+                continue
+            self.addrs.append(int(fields[0], 16))
+            self.names.append(fields[2])
+
+    def name(self, addr):
+        """The function `addr` is in."""
+        i = bisect.bisect_right(self.addrs, addr) - 1
+        return self.names[i] if i >= 0 else "0x%08x" % addr
+
+    def addr(self, name):
+        """The address of function `name`, or None."""
+        try:
+            return self.addrs[self.names.index(name)]
+        except ValueError:
+            return None
+
+
+def between(lines, begin, end):
+    """Yields the stripped, non-empty lines between `begin` and `end` lines."""
+    inside = False
+    for line in lines:
+        line = line.strip()
+        if line == begin:
+            inside = True
+        elif line == end:
+            inside = False
+        elif inside and line:
+            yield line
@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-3.0-or-later
+"""
+Turns profiler samples into folded stacks, for flamegraph.pl or speedscope.
+
+The kernel prints its samples between "profile: begin" and "profile: end" when
+booted with `profile` on the command line (see kernel/include/profile.h).
+Capture the serial output, e.g. with `-serial file:serial.log` in QEMU, then:
+
+    tools/profile-fold.py kernel/asternix.bin serial.log > out.folded
+    flamegraph.pl out.folded > out.svg
+
+Addresses are symbolized with `nm` ($NM, default i686-elf-nm if installed).
+"""
+
+import argparse
+import collections
+import sys
+
+from ksyms import Symbols, between
+
+
+def read_samples(lines):
+    for line in between(lines, "profile: begin", "profile: end"):
+        fields = line.split()
+        try:
+            yield int(fields[0]), [int(f, 16) for f in fields[1:]]
+        except ValueError:
+            print("skipping garbled line: " + line, file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("binary", help="the kernel the samples came from")
+    parser.add_argument("log", nargs="?", help="serial log (default stdin)")
+    parser.add_argument("--per-cpu", action="store_true",
+                        help="put each CPU at the root of its own stacks")
+    args = parser.parse_args()
+
+    symbols = Symbols(args.binary)
+    log = open(args.log, errors="replace") if args.log else sys.stdin
+
+    stacks = collections.Counter()
+    for cpu, entries in read_samples(log):
+        if not entries:
+            continue
+        # All but the first are return addresses, which may already be in the
+        # next function when the call was the last instruction.
+        frames = [symbols.name(entries[0])]
+        frames += [symbols.name(a - 1) for a in entries[1:]]
+        frames.reverse()
+        if args.per_cpu:
+            frames.insert(0, "cpu%d" % cpu)
+        stacks[";".join(frames)] += 1
+
+    for stack, count in sorted(stacks.items()):
+        print("%s %d" % (stack, count))
+
+
+if __name__ == "__main__":
+    main()